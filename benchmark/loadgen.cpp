@@ -0,0 +1,332 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <zmq.hpp>
+
+#include "../lib/core/defs.hpp"
+#include "../lib/ECS/coordinator.hpp"
+#include "../lib/EMS/event_stats.hpp"
+#include "../lib/model/components.hpp"
+#include "../lib/model/event.hpp"
+#include "../lib/helpers/network_helper.hpp"
+#include "../lib/helpers/random.hpp"
+#include "../lib/helpers/shard_endpoint.hpp"
+#include "../lib/helpers/transport_config.hpp"
+#include "../lib/server/server_config.hpp"
+#include "../lib/server/shard.hpp"
+#include "../lib/strategy/payload_samples.hpp"
+#include "../lib/strategy/snapshot_frame.hpp"
+#include "../lib/strategy/strategy_selector.hpp"
+#include "../lib/strategy/transform_delta.hpp"
+
+/**
+ * Headless load generator: simulates many players against a running shade_engine_server from one process, without
+ * SDL windows. Every simulated client speaks the protocol of the real one through the same Send_Strategy and
+ * NetworkHelper code: it announces its player with MainCharCreated, sends a predicted PositionChanged every frame,
+ * decodes and acknowledges its snapshots and answers nothing else. Prints once per second and at the end:
+ *   - updates sent and snapshots, deltas and messages received per second, i.e. what the server sustains
+ *   - end to end update latency, from sending an update to receiving the server's authority record for it, which
+ *     includes the wait for the next tick
+ *   - bandwidth in and out over all clients
+ * Usage: shade_engine_loadgen [format] [--clients 50] [--seconds 30] [--rate 60] [--pattern random|circle|still]
+ *                             [--endpoint tcp://localhost:5570] [--shards 1] [--serve]
+ * --shards is the SHADE_SHARDS of the server, which is also its default, the clients are spread over its shards.
+ * --endpoint defaults to the one of SHADE_TRANSPORT and SHADE_SERVER_ENDPOINT (see TransportConfig). --serve runs the
+ * shards of a server in this process too, with an empty world rather than the simulated players, so an inproc://
+ * endpoint, which implies it, measures the server and the clients without any socket in between. The traffic counted
+ * then includes the server's side.
+ */
+Coordinator gCoordinator;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string format = "float";
+        int clients = 50;
+        int seconds = 30;
+        int rate = 60;
+        std::string pattern = "random";
+        std::string endpoint = TransportConfig::fromEnvironment().connect;
+        int shards = ServerConfig::fromEnvironment().shards;
+        bool serve = false;
+    };
+
+    struct Totals {
+        std::atomic<uint64_t> updates{0};
+        std::atomic<uint64_t> snapshots{0};
+        std::atomic<uint64_t> deltas{0};
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> acknowledged{0};
+        LatencyHistogram latency;
+        // reset after every report line
+        LatencyHistogram recentLatency;
+    };
+
+    std::atomic<bool> running{true};
+
+    class SimulatedClient {
+        const Options &options;
+        Send_Strategy *strategy;
+        Totals &totals;
+        const int index;
+        const std::string identity = Random::generateRandomID(10);
+        Entity player;
+        std::string key;
+        TransformDelta::Decoder decoder;
+        uint32_t sequence = 0;
+        // send time of the updates the server has not answered yet
+        std::unordered_map<uint32_t, Clock::time_point> inFlight;
+        std::mt19937 generator;
+        SDL_FPoint direction{1, 0};
+
+        void move(Transform &transform, const float dt) {
+            constexpr float SPEED = 150.f;
+            if (options.pattern == "still") return;
+            if (options.pattern == "circle") {
+                const float angle = static_cast<float>(sequence) * dt + static_cast<float>(index);
+                transform.x += std::cos(angle) * SPEED * dt;
+                transform.y += std::sin(angle) * SPEED * dt;
+                return;
+            }
+            // random walk that changes direction now and then
+            if (generator() % 30 == 0) {
+                const float angle = static_cast<float>(generator() % 360) * 3.14159265f / 180.f;
+                direction = {std::cos(angle), std::sin(angle)};
+            }
+            transform.x = std::clamp(transform.x + direction.x * SPEED * dt, 0.f, static_cast<float>(SCREEN_WIDTH) * 4);
+            transform.y = std::clamp(transform.y + direction.y * SPEED * dt, 0.f, static_cast<float>(SCREEN_HEIGHT));
+        }
+
+        void sendEvent(zmq::socket_t &socket, Event event) {
+            NetworkHelper::sendMessageClient(socket, NetworkHelper::EVENT_ENTITY_ID, strategy->get_event(event));
+        }
+
+        void handleSnapshot(zmq::socket_t &reply, zmq::message_t &first) {
+            std::vector<zmq::message_t> parts;
+            parts.push_back(std::move(first));
+            NetworkHelper::receiveRemainingParts(reply, parts);
+            totals.snapshots.fetch_add(1, std::memory_order_relaxed);
+            std::string ack;
+            for (const auto &part: parts) {
+                try {
+                    SnapshotFrame::forEach(part.to_string_view(), [&](const std::string_view delta) {
+                        if (decoder.decode(delta, ack)) totals.deltas.fetch_add(1, std::memory_order_relaxed);
+                    }, [&](const std::string_view, const std::string_view) {
+                        totals.messages.fetch_add(1, std::memory_order_relaxed);
+                    }, [](const std::string_view, const bool) {
+                    }, [&](const SnapshotFrame::Authority &authority) {
+                        if (authority.key == key) acknowledge(authority.sequence);
+                    }, [&] {
+                        decoder.reset();
+                    }, [](const int64_t) {
+                    });
+                } catch (std::exception &e) {
+                    std::cerr << "Error decoding snapshot: " << e.what() << std::endl;
+                }
+            }
+            if (!ack.empty()) {
+                NetworkHelper::sendMessageClient(reply, NetworkHelper::ACK_ID, ack);
+            }
+        }
+
+        // the server answers the newest update of a tick, the ones before it are answered with it
+        void acknowledge(const uint32_t acknowledged) {
+            const auto now = Clock::now();
+            if (const auto it = inFlight.find(acknowledged); it != inFlight.end()) {
+                const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second).count();
+                totals.latency.record(nanos);
+                totals.recentLatency.record(nanos);
+                totals.acknowledged.fetch_add(1, std::memory_order_relaxed);
+            }
+            std::erase_if(inFlight, [acknowledged](const auto &entry) { return entry.first <= acknowledged; });
+        }
+
+    public:
+        SimulatedClient(const Options &options, Send_Strategy *strategy, Totals &totals, const int index)
+            : options(options), strategy(strategy), totals(totals), index(index), generator(index) {
+            player = gCoordinator.createEntity();
+            key = gCoordinator.getEntityKey(player);
+            // spread over a few screens so interest management has something to filter
+            const float x = static_cast<float>(index % 16) * SCREEN_WIDTH / 4.f;
+            const float y = static_cast<float>(index / 16 % 4) * SCREEN_HEIGHT / 4.f;
+            gCoordinator.addComponent(player, Transform{x, y, 32, 32, 0, 1});
+            gCoordinator.addComponent(player, Color{{static_cast<Uint8>(index * 40), 128, 255, 255}});
+            gCoordinator.addComponent(player, CKinematic{});
+            gCoordinator.addComponent(player, RigidBody{1.f});
+            gCoordinator.addComponent(player, Collision{true, false, CollisionLayer::PLAYER});
+            gCoordinator.addComponent(player, Destroy{});
+        }
+
+        void run(zmq::context_t &context) {
+            zmq::socket_t socket(context, ZMQ_DEALER);
+            socket.set(zmq::sockopt::routing_id, identity);
+            socket.connect(ShardEndpoint::forClient(options.endpoint, identity, options.shards));
+            zmq::socket_t reply(context, ZMQ_DEALER);
+            reply.set(zmq::sockopt::routing_id, identity + "R");
+            reply.connect(ShardEndpoint::forClient(options.endpoint, identity, options.shards));
+
+            sendEvent(socket, Event{
+                          eventTypeToString(EventType::MainCharCreated),
+                          MainCharCreatedData{player, key, creationComponents(player)}
+                      });
+
+            const auto frame = std::chrono::nanoseconds(1000000000 / options.rate);
+            const float dt = 1.f / static_cast<float>(options.rate);
+            auto nextFrame = Clock::now();
+            while (running) {
+                const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextFrame - Clock::now());
+                zmq::pollitem_t items[] = {{static_cast<void *>(reply), 0, ZMQ_POLLIN, 0}};
+                zmq::poll(items, 1, std::max(wait, std::chrono::milliseconds(0)));
+                while (items[0].revents & ZMQ_POLLIN) {
+                    zmq::message_t message;
+                    std::string entity_id;
+                    NetworkHelper::receiveMessageClient(reply, message, entity_id);
+                    if (entity_id == NetworkHelper::SNAPSHOT_ID) {
+                        handleSnapshot(reply, message);
+                    } else {
+                        totals.messages.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    items[0].revents = 0;
+                    zmq::poll(items, 1, std::chrono::milliseconds(0));
+                }
+                if (Clock::now() < nextFrame) continue;
+                nextFrame += frame;
+
+                move(gCoordinator.getComponent<Transform>(player), dt);
+                inFlight[++sequence] = Clock::now();
+                sendEvent(socket, Event{
+                              eventTypeToString(EventType::PositionChanged),
+                              PositionChangedData{key, gCoordinator.getComponent<Transform>(player), sequence}
+                          });
+                totals.updates.fetch_add(1, std::memory_order_relaxed);
+            }
+            NetworkHelper::sendMessageClient(socket, key, strategy->get_message(player, Message::DELETE));
+            NetworkHelper::sendMessageClient(socket, NetworkHelper::DISCONNECT_ID, "");
+        }
+    };
+
+    Options parse(const int argc, char *argv[]) {
+        Options options;
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            const auto next = [&] { return i + 1 < argc ? std::string(argv[++i]) : std::string(); };
+            if (arg == "--clients") options.clients = std::max(1, std::stoi(next()));
+            else if (arg == "--seconds") options.seconds = std::max(1, std::stoi(next()));
+            else if (arg == "--rate") options.rate = std::max(1, std::stoi(next()));
+            else if (arg == "--pattern") options.pattern = next();
+            else if (arg == "--endpoint") options.endpoint = next();
+            else if (arg == "--shards") options.shards = std::max(1, std::stoi(next()));
+            else if (arg == "--serve") options.serve = true;
+            else options.format = arg;
+        }
+        // nothing outside this process can be listening there
+        options.serve = options.serve || TransportConfig::forEndpoint(options.endpoint).inProcess();
+        return options;
+    }
+
+    // binds the shards of a server at the endpoint, they run until the process exits and are never freed
+    void serve(zmq::context_t &context, const Options &options, Send_Strategy *strategy) {
+        auto config = ServerConfig::fromEnvironment();
+        config.shards = options.shards;
+        // gCoordinator holds the simulated players, which join the served world as clients like any other
+        auto *bootstrap = new WorldBootstrap(false);
+        const auto bind = TransportConfig::bindOf(options.endpoint);
+        for (int i = 0; i < config.shards; i++) {
+            auto *shard = new Shard(context, i, config, bind);
+            shard->start(strategy, *bootstrap);
+            std::thread(&Shard::proxy, shard).detach();
+        }
+    }
+
+    std::string millis(const uint64_t nanos) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << static_cast<double>(nanos) / 1e6 << "ms";
+        return out.str();
+    }
+
+    void report(const std::string &label, const uint64_t updates, const uint64_t snapshots, const uint64_t deltas,
+                const uint64_t messages, const NetworkStats::Totals &traffic, const double seconds,
+                const LatencyHistogram &latency) {
+        const auto perSecond = [seconds](const uint64_t count) {
+            return static_cast<double>(count) / std::max(seconds, 1e-3);
+        };
+        std::cout << std::fixed << std::setprecision(0) << label << " | sent " << perSecond(updates) << " upd/s"
+                << " | recv " << perSecond(snapshots) << " snap/s " << perSecond(deltas) << " deltas/s "
+                << perSecond(messages) << " msg/s" << std::setprecision(1)
+                << " | in " << perSecond(traffic.bytesIn) / 1024 << " KB/s out " << perSecond(traffic.bytesOut) / 1024
+                << " KB/s | latency p50 " << millis(latency.percentile(0.5)) << " p95 "
+                << millis(latency.percentile(0.95)) << " p99 " << millis(latency.percentile(0.99)) << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const auto options = parse(argc, argv);
+    const auto strategy = Strategy::select_message_strategy(options.format);
+
+    gCoordinator.init();
+    gCoordinator.registerComponent<Transform>();
+    gCoordinator.registerComponent<Color>();
+    gCoordinator.registerComponent<CKinematic>();
+    gCoordinator.registerComponent<RigidBody>();
+    gCoordinator.registerComponent<Collision>();
+    gCoordinator.registerComponent<Destroy>();
+    gCoordinator.registerComponent<VerticalBoost>();
+    Strategy::setupCompression(strategy.get());
+
+    std::cout << "Simulating " << options.clients << " clients at " << options.rate << " updates/s against "
+            << options.endpoint << (options.serve ? " served in process" : "") << " for " << options.seconds << "s"
+            << std::endl;
+    // a served server's threads never stop, so its context, which the clients share for inproc, is never closed
+    auto &context = *new zmq::context_t(1);
+    Totals totals;
+    std::vector<std::unique_ptr<SimulatedClient> > clients;
+    for (int i = 0; i < options.clients; i++) {
+        clients.push_back(std::make_unique<SimulatedClient>(options, strategy.get(), totals, i));
+    }
+    if (options.serve) {
+        serve(context, options, strategy.get());
+    }
+    std::vector<std::thread> threads;
+    for (auto &client: clients) {
+        threads.emplace_back(&SimulatedClient::run, client.get(), std::ref(context));
+    }
+
+    const auto start = Clock::now();
+    uint64_t updates = 0, snapshots = 0, deltas = 0, messages = 0;
+    NetworkStats::Totals traffic;
+    for (int second = 1; second <= options.seconds; second++) {
+        std::this_thread::sleep_until(start + std::chrono::seconds(second));
+        const auto current = networkStats().totals();
+        report("t=" + std::to_string(second) + "s", totals.updates - updates, totals.snapshots - snapshots,
+               totals.deltas - deltas, totals.messages - messages,
+               {0, 0, current.bytesIn - traffic.bytesIn, current.bytesOut - traffic.bytesOut, 0}, 1.0,
+               totals.recentLatency);
+        totals.recentLatency.reset();
+        updates = totals.updates;
+        snapshots = totals.snapshots;
+        deltas = totals.deltas;
+        messages = totals.messages;
+        traffic = current;
+    }
+    running = false;
+    for (auto &thread: threads) {
+        thread.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << std::endl << "Total over " << options.clients << " clients, " << totals.acknowledged
+            << " updates answered, " << networkStats().totals().dropped << " dropped" << std::endl;
+    report("all", totals.updates, totals.snapshots, totals.deltas, totals.messages, networkStats().totals(), seconds,
+           totals.latency);
+    std::cout << "Compression: " << Compression::summary() << std::endl;
+    return 0;
+}
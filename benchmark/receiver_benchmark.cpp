@@ -0,0 +1,177 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+
+#include "../lib/ECS/coordinator.hpp"
+#include "../lib/EMS/event_coordinator.hpp"
+#include "../lib/EMS/event_stats.hpp"
+#include "../lib/model/components.hpp"
+#include "../lib/model/event.hpp"
+#include "../lib/helpers/network_helper.hpp"
+#include "../lib/server/transform_replicator.hpp"
+#include "../lib/strategy/snapshot_frame.hpp"
+#include "../lib/strategy/strategy_selector.hpp"
+#include "../lib/systems/receiver.hpp"
+
+/**
+ * Latency of the client's ReceiverSystem under a steady inbound load. A fake server thread sends one snapshot holding
+ * a single Transform delta per message at the given rate over inproc, round robin over a few entities, and handles the
+ * acknowledgements like the real server. The receiver thread runs the ReceiverSystem loop of the game. Latency is
+ * measured from sending an update to its TransformReplicated event, the x of every update is its send index. Updates
+ * that were coalesced into a newer one of the same entity are counted, not measured.
+ *   --rate     messages per second (default 1000)
+ *   --seconds  how long to send (default 5)
+ *   --entities entities the updates are spread over (default 16)
+ *   --work     microseconds every TransformReplicated handler spins, the cost of applying it (default 0)
+ * Usage: shade_engine_receiver_benchmark [format] [--rate 1000] [--seconds 5] [--entities 16] [--work 0]
+ */
+Coordinator gCoordinator;
+EventCoordinator eventCoordinator;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr auto ENDPOINT = "inproc://receiver-benchmark";
+    const std::string CLIENT = "benchmark";
+
+    struct Options {
+        std::string format = "float";
+        int rate = 1000;
+        int seconds = 5;
+        int entities = 16;
+        int work = 0;
+    };
+
+    std::atomic<bool> sending{true};
+    std::atomic<bool> receiving{true};
+
+    Options parse(const int argc, char *argv[]) {
+        Options options;
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            const auto next = [&] { return i + 1 < argc ? std::string(argv[++i]) : std::string(); };
+            if (arg == "--rate") options.rate = std::max(1, std::stoi(next()));
+            else if (arg == "--seconds") options.seconds = std::max(1, std::stoi(next()));
+            else if (arg == "--entities") options.entities = std::max(1, std::stoi(next()));
+            else if (arg == "--work") options.work = std::max(0, std::stoi(next()));
+            else options.format = arg;
+        }
+        return options;
+    }
+
+    int64_t nanosOf(const Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    // the fake server: one snapshot per message, acknowledgements applied so the deltas stay as small as in the game
+    void serve(zmq::context_t &context, const Options &options, std::vector<std::atomic<int64_t> > &sentAt) {
+        zmq::socket_t socket(context, ZMQ_ROUTER);
+        socket.bind(ENDPOINT);
+        TransformReplicator replicator;
+        const auto interval = std::chrono::nanoseconds(1000000000 / options.rate);
+        auto next = Clock::now();
+        std::string frame;
+        std::string delta;
+        for (size_t index = 0; index < sentAt.size() && sending; index++) {
+            zmq::pollitem_t items[] = {{static_cast<void *>(socket), 0, ZMQ_POLLIN, 0}};
+            while (zmq::poll(items, 1, std::chrono::milliseconds(0)) > 0) {
+                zmq::message_t identity;
+                zmq::message_t entity_id;
+                zmq::message_t data;
+                NetworkHelper::receiveMessageServer(socket, identity, entity_id, data);
+                if (entity_id.to_string() == NetworkHelper::ACK_ID) {
+                    replicator.acknowledge(CLIENT, data.to_string_view());
+                }
+            }
+            std::this_thread::sleep_until(next);
+            next += interval;
+
+            Transform transform{static_cast<float>(index), 100, 32, 32, 0, 1};
+            frame.clear();
+            delta.clear();
+            replicator.encode(CLIENT, "entity" + std::to_string(index % options.entities), transform, delta);
+            SnapshotFrame::appendDelta(frame, delta);
+            sentAt[index].store(nanosOf(Clock::now()), std::memory_order_release);
+            NetworkHelper::sendMessageServer(socket, CLIENT, NetworkHelper::SNAPSHOT_ID, frame);
+        }
+        // let the receiver drain what is still queued
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        receiving = false;
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    const auto options = parse(argc, argv);
+    const auto strategy = Strategy::select_message_strategy(options.format);
+    gCoordinator.init();
+    gCoordinator.registerComponent<Transform>();
+    gCoordinator.registerComponent<Color>();
+    gCoordinator.registerComponent<RigidBody>();
+    gCoordinator.registerComponent<Collision>();
+    gCoordinator.registerComponent<CKinematic>();
+    gCoordinator.registerComponent<Destroy>();
+    gCoordinator.registerComponent<VerticalBoost>();
+    gCoordinator.registerComponent<ClientEntity>();
+    gCoordinator.registerComponent<Receiver>();
+    const auto receiverSystem = gCoordinator.registerSystem<ReceiverSystem>();
+
+    std::vector<std::atomic<int64_t> > sentAt(static_cast<size_t>(options.rate) * options.seconds);
+    LatencyHistogram latency;
+    std::atomic<uint64_t> applied{0};
+    auto handle = eventCoordinator.subscribe([&](const std::shared_ptr<Event> &event) {
+        const auto now = nanosOf(Clock::now());
+        const TransformReplicatedData data = event->data;
+        const auto index = static_cast<size_t>(std::lround(data.transform.x));
+        if (index < sentAt.size()) {
+            latency.record(static_cast<uint64_t>(std::max<int64_t>(
+                now - sentAt[index].load(std::memory_order_acquire), 0)));
+        }
+        applied.fetch_add(1, std::memory_order_relaxed);
+        const auto until = Clock::now() + std::chrono::microseconds(options.work);
+        while (Clock::now() < until) {
+        }
+    }, eventTypeToString(EventType::TransformReplicated), Executor::ANY);
+
+    zmq::context_t context(1);
+    std::thread server(serve, std::ref(context), std::cref(options), std::ref(sentAt));
+    // inproc needs the endpoint bound before connecting
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::cout << "Receiving " << options.rate << " msg/s for " << options.seconds << " s over " << options.entities
+            << " entities, " << options.work << " us per applied update (" << options.format << ")" << std::endl;
+    const auto start = Clock::now();
+    {
+        zmq::socket_t socket(context, ZMQ_DEALER);
+        socket.set(zmq::sockopt::routing_id, CLIENT + "R");
+        socket.connect(ENDPOINT);
+        EventCoordinator::bindThread(Executor::NETWORK);
+        while (receiving) {
+            receiverSystem->update(socket, strategy.get());
+            eventCoordinator.dispatch(Executor::NETWORK);
+        }
+    }
+    server.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    eventCoordinator.unsubscribe(handle);
+
+    const auto formatMillis = [](const uint64_t nanos) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << static_cast<double>(nanos) / 1e6 << " ms";
+        return out.str();
+    };
+    const auto sent = sentAt.size();
+    std::cout << "sent " << sent << ", applied " << applied << " (" << sent - std::min<uint64_t>(applied, sent)
+            << " coalesced) in " << std::fixed << std::setprecision(2) << seconds << " s" << std::endl;
+    std::cout << "latency p50 " << formatMillis(latency.percentile(0.5)) << "  p95 "
+            << formatMillis(latency.percentile(0.95)) << "  p99 " << formatMillis(latency.percentile(0.99))
+            << "  max " << formatMillis(latency.percentile(1.0)) << std::endl;
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <zmq.hpp>
+
+#include "../lib/ECS/coordinator.hpp"
+#include "../lib/model/components.hpp"
+#include "../lib/model/event.hpp"
+#include "../lib/helpers/compression.hpp"
+#include "../lib/strategy/payload_samples.hpp"
+#include "../lib/strategy/snapshot_frame.hpp"
+#include "../lib/strategy/strategy_selector.hpp"
+
+/**
+ * Compares the wire formats of the send strategies: bytes per message and encode / decode time for a position
+ * update, the CREATE bootstrap of an entity and a PositionChanged event carrying an update. Then the same payloads
+ * and a whole world bootstrap part through every compression codec: bytes after compression and the time it costs.
+ * Usage: shade_engine_strategy_benchmark [iterations]
+ */
+Coordinator gCoordinator;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int ENTITIES = 64;
+
+    struct Result {
+        size_t bytes = 0;
+        double encodeNanos = 0;
+        double decodeNanos = 0;
+    };
+
+    template<typename Encode, typename Decode>
+    Result measure(const int iterations, Encode encode, Decode decode) {
+        Result result;
+        std::vector<std::string> encoded;
+        encoded.reserve(ENTITIES);
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            auto message = encode(i);
+            if (i < ENTITIES) {
+                result.bytes += message.size();
+                encoded.push_back(std::move(message));
+            }
+        }
+        result.encodeNanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 Clock::now() - start).count()) / iterations;
+        result.bytes /= std::min(iterations, ENTITIES);
+
+        start = Clock::now();
+        size_t checksum = 0;
+        for (int i = 0; i < iterations; i++) {
+            checksum += decode(encoded[i % encoded.size()]);
+        }
+        result.decodeNanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 Clock::now() - start).count()) / iterations;
+        if (checksum == 0) std::cerr << "Nothing was decoded" << std::endl;
+        return result;
+    }
+
+    void print(const std::string &format, const std::string &message, const Result &result) {
+        std::cout << std::left << std::setw(18) << format << std::setw(16) << message << std::right
+                << std::setw(8) << result.bytes << std::fixed << std::setprecision(1)
+                << std::setw(14) << result.encodeNanos << std::setw(14) << result.decodeNanos
+                << std::setw(14) << static_cast<double>(result.bytes) * 1000.0 / result.encodeNanos << std::endl;
+    }
+
+    // bytes of the payloads packed with the codec and the time per payload to pack and unpack them
+    void measureCompression(const std::string &format, const std::string &message,
+                            const std::vector<std::string> &payloads, const int iterations) {
+        for (const auto codec: {Compression::RAW, Compression::LZ, Compression::LZ_DICTIONARY}) {
+            Compression::settings() = Compression::Settings{codec, 0};
+            Result result;
+            std::vector<std::optional<Compression::Packed> > packed;
+            for (const auto &payload: payloads) {
+                packed.push_back(Compression::pack(payload));
+                result.bytes += packed.back() ? packed.back()->body.size() : payload.size();
+            }
+            result.bytes /= payloads.size();
+
+            auto start = Clock::now();
+            for (int i = 0; i < iterations; i++) {
+                auto _ = Compression::pack(payloads[i % payloads.size()]);
+            }
+            result.encodeNanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     Clock::now() - start).count()) / iterations;
+
+            start = Clock::now();
+            size_t checksum = 0;
+            for (int i = 0; i < iterations; i++) {
+                const auto &entry = packed[i % packed.size()];
+                checksum += entry ? Compression::unpack(entry->codec, entry->body).size() : 1;
+            }
+            result.decodeNanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     Clock::now() - start).count()) / iterations;
+            if (checksum == 0) std::cerr << "Nothing was decoded" << std::endl;
+
+            const std::string names[] = {"off", "lz", "dictionary"};
+            print(format + " " + names[codec], message, result);
+        }
+    }
+
+    std::vector<Entity> createEntities() {
+        gCoordinator.init();
+        gCoordinator.registerComponent<Transform>();
+        gCoordinator.registerComponent<Color>();
+        gCoordinator.registerComponent<RigidBody>();
+        gCoordinator.registerComponent<Collision>();
+        gCoordinator.registerComponent<CKinematic>();
+        gCoordinator.registerComponent<Destroy>();
+        gCoordinator.registerComponent<VerticalBoost>();
+
+        std::vector<Entity> entities;
+        for (int i = 0; i < ENTITIES; i++) {
+            const auto entity = gCoordinator.createEntity();
+            gCoordinator.addComponent(entity, Transform{100.f + i * 13.37f, 400.25f - i, 32, 32, 0, 1});
+            gCoordinator.addComponent(entity, Color{{255, 128, 0, 255}});
+            gCoordinator.addComponent(entity, RigidBody{1.f});
+            gCoordinator.addComponent(entity, Collision{true, false, CollisionLayer::PLAYER});
+            gCoordinator.addComponent(entity, CKinematic{});
+            gCoordinator.addComponent(entity, Destroy{});
+            entities.push_back(entity);
+        }
+        return entities;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? std::stoi(argv[1]) : 200000;
+    const auto entities = createEntities();
+
+    std::cout << std::left << std::setw(18) << "format" << std::setw(16) << "message" << std::right << std::setw(8)
+            << "bytes" << std::setw(14) << "encode ns" << std::setw(14) << "decode ns" << std::setw(14) << "encode MB/s"
+            << std::endl;
+    for (const auto *format: {"json", "binary-float", "binary"}) {
+        const auto strategy = Strategy::select_message_strategy(format);
+        const auto entityAt = [&entities](const int i) {
+            const auto entity = entities[i % entities.size()];
+            gCoordinator.getComponent<Transform>(entity).x += 0.5f;
+            return entity;
+        };
+
+        print(format, "UPDATE", measure(iterations, [&](const int i) {
+            return strategy->get_message(entityAt(i), Message::UPDATE);
+        }, [&](const std::string &message) {
+            return strategy->parse_message(message).components.size();
+        }));
+
+        print(format, "CREATE", measure(iterations / 10, [&](const int i) {
+            return strategy->get_message(entityAt(i), Message::CREATE);
+        }, [&](const std::string &message) {
+            return strategy->parse_message(message).components.size();
+        }));
+
+        print(format, "PositionChanged", measure(iterations, [&](const int i) {
+            const auto entity = entityAt(i);
+            Event event{
+                eventTypeToString(EventType::PositionChanged),
+                PositionChangedData{gCoordinator.getEntityKey(entity), gCoordinator.getComponent<Transform>(entity)}
+            };
+            return strategy->get_event(event);
+        }, [&](const std::string &message) {
+            zmq::message_t frame(message.data(), message.size());
+            const Event event = strategy->parse_event(frame);
+            const PositionChangedData data = event.data;
+            return static_cast<size_t>(data.transform.x);
+        }));
+    }
+
+    std::cout << std::endl << std::left << std::setw(18) << "format codec" << std::setw(16) << "payload" << std::right
+            << std::setw(8) << "bytes" << std::setw(14) << "pack ns" << std::setw(14) << "unpack ns"
+            << std::setw(14) << "MB/s out" << std::endl;
+    for (const auto *format: {"json", "binary"}) {
+        const auto strategy = Strategy::select_message_strategy(format);
+        Compression::dictionary() = Compression::trainDictionary(Strategy::samplePayloads(strategy.get()));
+
+        std::vector<std::string> updates;
+        std::vector<std::string> creates;
+        std::vector<std::string> events;
+        std::string bootstrap;
+        for (const auto entity: entities) {
+            gCoordinator.getComponent<Transform>(entity).x += 0.5f;
+            updates.push_back(strategy->get_message(entity, Message::UPDATE));
+            creates.push_back(strategy->get_message(entity, Message::CREATE));
+            Event event{
+                eventTypeToString(EventType::PositionChanged),
+                PositionChangedData{gCoordinator.getEntityKey(entity), gCoordinator.getComponent<Transform>(entity)}
+            };
+            events.push_back(strategy->get_event(event));
+            SnapshotFrame::appendMessage(bootstrap, gCoordinator.getEntityKey(entity), creates.back());
+        }
+        measureCompression(format, "UPDATE", updates, iterations);
+        measureCompression(format, "CREATE", creates, iterations / 10);
+        measureCompression(format, "PositionChanged", events, iterations);
+        measureCompression(format, "bootstrap", {bootstrap}, iterations / 100);
+    }
+    return 0;
+}
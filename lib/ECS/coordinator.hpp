@@ -3,9 +3,12 @@
 //
 
 #pragma once
+#include <array>
+#include <functional>
 #include <memory>
 #include <unordered_map>
 #include <shared_mutex>
+#include <vector>
 
 #include "component_manager.hpp"
 #include "entity_manager.hpp"
@@ -14,6 +17,8 @@
 
 using StateSerializer = std::function<void(nlohmann::json &, Entity &)>;
 using StateDeserializer = std::function<void(nlohmann::json &, Entity &)>;
+// told the entity and its key whenever an entity is created, destroyed or changed, see Coordinator::watch
+using EntityWatcher = std::function<void(Entity, const std::string &, bool destroyed)>;
 
 class Coordinator {
 private:
@@ -21,10 +26,21 @@ private:
     std::unique_ptr<EntityManager> entity_manager;
     std::unique_ptr<SystemManager> system_manager;
     std::unordered_map<std::string, Entity> entities;
+    // key of every entity by its id, so getEntityKey does not have to search entities
+    std::array<std::string, MAX_ENTITIES> keys;
     mutable std::shared_mutex mutex;
+    // unwatched ones are left empty so the ids of the others stay valid
+    std::vector<EntityWatcher> watchers;
 
     Snapshot snapshot{};
 
+    // called with the mutex held
+    void notify(const Entity entity, const bool destroyed) const {
+        for (const auto &watcher: watchers) {
+            if (watcher) watcher(entity, keys[entity], destroyed);
+        }
+    }
+
 public:
     void init() {
         component_manager = std::make_unique<ComponentManager>();
@@ -36,7 +52,10 @@ public:
     Entity createEntity() {
         std::lock_guard<std::shared_mutex> lock(mutex);
         const Entity id = entity_manager->createEntity();
-        entities[createKey(id)] = id;
+        auto key = createKey(id);
+        entities[key] = id;
+        keys[id] = std::move(key);
+        notify(id, false);
         return id;
     }
 
@@ -47,6 +66,8 @@ public:
         }
         const Entity id = entity_manager->createEntity();
         entities[key] = id;
+        keys[id] = key;
+        notify(id, false);
         return id;
     }
 
@@ -56,8 +77,10 @@ public:
 
         component_manager->entityDestroyed(entity);
         system_manager->entityDestroyed(entity);
+        notify(entity, true);
 
-        entities.erase(getEntityKey(entity));
+        entities.erase(keys[entity]);
+        keys[entity].clear();
     }
 
     void destroyEntity(const std::string &key) {
@@ -85,6 +108,7 @@ public:
         entity_manager->setSignature(entity, signature);
 
         system_manager->entitySignatureChanged(entity, signature);
+        notify(entity, false);
     }
 
     template<typename T>
@@ -97,6 +121,32 @@ public:
         entity_manager->setSignature(entity, signature);
 
         system_manager->entitySignatureChanged(entity, signature);
+        notify(entity, false);
+    }
+
+    /**
+     * Tells the watchers that a component of the entity was written in place through getComponent, which the
+     * coordinator cannot notice by itself
+     */
+    void changed(const Entity entity) const {
+        std::shared_lock lock(mutex);
+        notify(entity, false);
+    }
+
+    /**
+     * Calls watcher whenever an entity is created or destroyed, a component is added to or removed from one or it is
+     * marked changed, returns the id to unwatch with. The watcher runs with the coordinator locked, possibly on several
+     * threads at once, so it must be thread safe and must not call back into the coordinator.
+     */
+    size_t watch(EntityWatcher watcher) {
+        std::lock_guard<std::shared_mutex> lock(mutex);
+        watchers.push_back(std::move(watcher));
+        return watchers.size() - 1;
+    }
+
+    void unwatch(const size_t id) {
+        std::lock_guard<std::shared_mutex> lock(mutex);
+        watchers[id] = nullptr;
     }
 
     template<typename T>
@@ -162,12 +212,15 @@ public:
     }
 
     std::string getEntityKey(const Entity id) {
-        for (auto &[key, value]: entities) {
-            if (value == id) {
-                return key;
-            }
-        }
-        return "";
+        if (id >= MAX_ENTITIES) return "";
+        std::shared_lock lock(mutex);
+        return keys[id];
+    }
+
+    // the components the entity has, changes whenever one is added or removed
+    Signature getSignature(const Entity entity) const {
+        std::shared_lock lock(mutex);
+        return entity_manager->getSignature(entity);
     }
 
     static std::string createKey(Entity id) {
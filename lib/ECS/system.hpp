@@ -14,4 +14,16 @@ class System {
 public:
     std::set<Entity> entities;
     std::mutex update_mutex;
+
+    virtual ~System() = default;
+
+    /**
+     * Called when an entity starts or stops matching the signature of the system. The coordinator is locked while
+     * these run so they must not call back into it
+     */
+    virtual void entityAdded(Entity entity) {
+    }
+
+    virtual void entityRemoved(Entity entity) {
+    }
 };
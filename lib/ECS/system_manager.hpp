@@ -38,7 +38,9 @@ public:
         for (auto const& pair : systems) {
             auto const& system = pair.second;
 
-            system->entities.erase(entity);
+            if (system->entities.erase(entity) > 0) {
+                system->entityRemoved(entity);
+            }
         }
     }
 
@@ -49,9 +51,11 @@ public:
             auto const& systemSignature = signatures[type];
 
             if ((entitySignature & systemSignature) == systemSignature) {
-                system->entities.insert(entity);
-            } else {
-                system->entities.erase(entity);
+                if (system->entities.insert(entity).second) {
+                    system->entityAdded(entity);
+                }
+            } else if (system->entities.erase(entity) > 0) {
+                system->entityRemoved(entity);
             }
         }
     }
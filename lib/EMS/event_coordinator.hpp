@@ -15,12 +15,39 @@ public:
         eventManager = std::make_unique<EventManager>();
     }
 
-    void subscribe(const EventHandler &handler, const std::string &type) const {
-        eventManager->subscribe(handler, type);
+    [[nodiscard]] SubscriptionHandle subscribe(const EventHandler &handler, const std::string &type,
+                                               const Executor executor = Executor::ANY) const {
+        return eventManager->subscribe(handler, type, executor);
     }
 
-    void unsubscribe(const EventHandler &handler, const std::string &type) const {
-        eventManager->unsubscribe(handler, type);
+    [[nodiscard]] SubscriptionHandle subscribe(const EventHandler &handler, const std::string &type,
+                                               const Entity entity, const Executor executor = Executor::ANY) const {
+        return eventManager->subscribe(handler, type, entity, executor);
+    }
+
+    // like subscribe, the handler is unsubscribed when the returned subscription is destroyed
+    [[nodiscard]] ScopedSubscription subscribeScoped(const EventHandler &handler, const std::string &type,
+                                                     const Executor executor = Executor::ANY) const {
+        return {*eventManager, eventManager->subscribe(handler, type, executor)};
+    }
+
+    [[nodiscard]] ScopedSubscription subscribeScoped(const EventHandler &handler, const std::string &type,
+                                                     const Entity entity,
+                                                     const Executor executor = Executor::ANY) const {
+        return {*eventManager, eventManager->subscribe(handler, type, entity, executor)};
+    }
+
+    static void bindThread(const Executor executor) {
+        EventManager::bindThread(executor);
+    }
+
+    // runs the events posted to the executor by other threads, called once per loop by the executor's thread
+    void dispatch(const Executor executor) const {
+        eventManager->dispatch(executor);
+    }
+
+    void unsubscribe(SubscriptionHandle &handle) const {
+        eventManager->unsubscribe(handle);
     }
 
     void emit(const std::shared_ptr<Event>& event) const {
@@ -31,17 +58,54 @@ public:
         eventManager->emitToServer(socket, event);
     }
 
+    void emitServer(zmq::socket_t &socket, const std::vector<std::shared_ptr<Event> > &events) const {
+        eventManager->emitToServer(socket, events);
+    }
+
+    // encodes events sent to the server in the wire format of the send strategy, must be set before threads start
+    void setEventEncoder(EventEncoder encoder) const {
+        eventManager->setEventEncoder(std::move(encoder));
+    }
+
+    void setCoalescible(const std::string &type, CoalesceKey key = nullptr) const {
+        eventManager->setCoalescible(type, std::move(key));
+    }
+
     void queueEvent(std::shared_ptr<Event> event, const int64_t time, const Priority priority) const {
         EventData eventData(std::move(event), time, priority);
         eventManager->queueEvent(std::make_shared<EventData>(eventData));
     }
 
+    void post(const std::shared_ptr<Event> &event) const {
+        eventManager->post(event);
+    }
+
     void clearQueue() const {
         eventManager->clearQueue();
     }
 
     void processEventsInQueue(const int64_t timestamp) const {
         eventManager->processEventQueue(timestamp);
+        eventManager->getStats().frame();
+    }
+
+    void dumpStats(std::ostream &out) const {
+        eventManager->getStats().dump(out);
+    }
+
+    // starts recording a chrome trace or, if one is running, stops it and writes it to the given file
+    void toggleTrace(const std::string &path) const {
+        if (auto &stats = eventManager->getStats(); stats.isTracing()) {
+            stats.stopTrace(path);
+        } else {
+            stats.startTrace();
+            std::cout << "Tracing events" << std::endl;
+        }
+    }
+
+    // records every event to a memory mapped ring file, must be called before other threads start emitting
+    bool openJournal(const std::string &path) const {
+        return eventManager->openJournal(path);
     }
 };
 
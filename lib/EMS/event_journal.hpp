@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "types.hpp"
+
+/**
+ * Flight recorder for the event system. Every event is appended to a ring buffer that lives in a memory mapped file,
+ * so writing an event is a msgpack encode into a reused buffer plus a memcpy into the mapping, and the kernel flushes
+ * the pages on its own. The file survives a crash and can be inspected with the shade_engine_journal tool.
+ *
+ * Layout: a JournalHeader followed by `capacity` bytes of records. `head` and `tail` are positions that only ever
+ * grow, the byte offset of a position is position % capacity. Records never wrap around the end of the ring, the gap
+ * at the end is filled with a padding record instead.
+ */
+namespace journal {
+    constexpr char MAGIC[8] = {'S', 'H', 'A', 'D', 'E', 'J', 'N', 'L'};
+    constexpr uint32_t VERSION = 1;
+    constexpr uint64_t DEFAULT_CAPACITY = 64ull << 20;
+
+    enum RecordKind : uint8_t {
+        PADDING = 0,
+        EMITTED = 1,
+        QUEUED = 2,
+        SENT = 3,
+    };
+
+    inline const char *kindToString(const uint8_t kind) {
+        switch (kind) {
+            case EMITTED: return "emit";
+            case QUEUED: return "queue";
+            case SENT: return "send";
+            default: return "pad";
+        }
+    }
+
+    struct JournalHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t capacity;
+        std::atomic<uint64_t> head; // end of the last complete record
+        std::atomic<uint64_t> tail; // start of the oldest record that has not been overwritten
+        uint64_t reserved[3];
+    };
+
+    static_assert(sizeof(JournalHeader) == 64);
+
+    struct RecordHeader {
+        uint32_t size; // whole record including this header, multiple of 8
+        uint8_t kind;
+        uint8_t typeLength;
+        uint16_t reserved;
+        uint32_t payloadSize;
+        uint32_t padding;
+        int64_t wallTime; // nanoseconds since the unix epoch
+        int64_t scheduled; // timeline timestamp of queued events, 0 otherwise
+    };
+
+    static_assert(sizeof(RecordHeader) == 32);
+
+    struct Record {
+        uint8_t kind;
+        int64_t wallTime;
+        int64_t scheduled;
+        std::string type;
+        const uint8_t *payload;
+        size_t payloadSize;
+    };
+
+    constexpr uint32_t align(const size_t size) {
+        return static_cast<uint32_t>((size + 7) & ~static_cast<size_t>(7));
+    }
+
+    /**
+     * Maps a journal file. Used by the writer and by the reader tool
+     */
+    class MappedFile {
+    protected:
+        int fd = -1;
+        uint8_t *base = nullptr;
+        size_t length = 0;
+
+    public:
+        MappedFile() = default;
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile() {
+            if (base) munmap(base, length);
+            if (fd >= 0) close(fd);
+        }
+
+        bool open(const std::string &path, const bool writable, const size_t size = 0) {
+            fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+            if (fd < 0) return false;
+            if (writable && ftruncate(fd, static_cast<off_t>(size)) != 0) return false;
+            struct stat info{};
+            if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(JournalHeader))) return false;
+            length = static_cast<size_t>(info.st_size);
+            void *mapping = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED) return false;
+            base = static_cast<uint8_t *>(mapping);
+            return true;
+        }
+
+        [[nodiscard]] JournalHeader *header() const {
+            return reinterpret_cast<JournalHeader *>(base);
+        }
+
+        [[nodiscard]] uint8_t *ring() const {
+            return base + sizeof(JournalHeader);
+        }
+
+        [[nodiscard]] bool valid() const {
+            return base && std::memcmp(header()->magic, MAGIC, sizeof(MAGIC)) == 0 && header()->version == VERSION &&
+                   header()->capacity + sizeof(JournalHeader) <= length;
+        }
+
+        /**
+         * Calls the visitor for every record between tail and head, oldest first
+         */
+        void forEach(const std::function<void(const Record &)> &visitor) const {
+            const auto *h = header();
+            const uint64_t head = h->head.load(std::memory_order_acquire);
+            uint64_t position = h->tail.load(std::memory_order_acquire);
+            while (position < head) {
+                RecordHeader record{};
+                std::memcpy(&record, ring() + position % h->capacity, sizeof(RecordHeader));
+                if (record.size < sizeof(RecordHeader) || record.size > h->capacity) {
+                    std::cerr << "Corrupt journal record at " << position << std::endl;
+                    return;
+                }
+                if (record.kind != PADDING) {
+                    const auto *data = ring() + position % h->capacity + sizeof(RecordHeader);
+                    visitor({
+                        record.kind, record.wallTime, record.scheduled,
+                        std::string(reinterpret_cast<const char *>(data), record.typeLength),
+                        data + record.typeLength, record.payloadSize
+                    });
+                }
+                position += record.size;
+            }
+        }
+    };
+}
+
+class EventJournal : journal::MappedFile {
+    std::mutex writeMutex;
+    std::vector<uint8_t> payload;
+
+    // Makes room for `size` bytes at head by retiring the oldest records. Called with writeMutex held
+    void reserve(const uint64_t size) {
+        auto *h = header();
+        const uint64_t head = h->head.load(std::memory_order_relaxed);
+        uint64_t tail = h->tail.load(std::memory_order_relaxed);
+        while (head + size - tail > h->capacity) {
+            journal::RecordHeader oldest{};
+            std::memcpy(&oldest, ring() + tail % h->capacity, sizeof(journal::RecordHeader));
+            tail += oldest.size;
+        }
+        h->tail.store(tail, std::memory_order_release);
+    }
+
+    void write(const journal::RecordHeader &record, const std::string &type) {
+        auto *h = header();
+        uint64_t head = h->head.load(std::memory_order_relaxed);
+        const uint64_t untilEnd = h->capacity - head % h->capacity;
+        if (record.size > untilEnd) {
+            // records never wrap, pad the rest of the ring and start over at the beginning
+            reserve(untilEnd);
+            journal::RecordHeader padding{};
+            padding.size = static_cast<uint32_t>(untilEnd);
+            std::memcpy(ring() + head % h->capacity, &padding, sizeof(padding));
+            head += untilEnd;
+            h->head.store(head, std::memory_order_release);
+        }
+        reserve(record.size);
+        uint8_t *out = ring() + head % h->capacity;
+        std::memcpy(out, &record, sizeof(record));
+        std::memcpy(out + sizeof(record), type.data(), record.typeLength);
+        std::memcpy(out + sizeof(record) + record.typeLength, payload.data(), record.payloadSize);
+        const size_t used = sizeof(record) + record.typeLength + record.payloadSize;
+        std::memset(out + used, 0, record.size - used);
+        h->head.store(head + record.size, std::memory_order_release);
+    }
+
+public:
+    /**
+     * Opens the journal, creating or truncating the file to hold `capacity` bytes of records
+     */
+    bool open(const std::string &path, const uint64_t capacity = journal::DEFAULT_CAPACITY) {
+        if (!MappedFile::open(path, true, sizeof(journal::JournalHeader) + capacity)) {
+            std::cerr << "Could not open event journal " << path << std::endl;
+            return false;
+        }
+        auto *h = header();
+        std::memcpy(h->magic, journal::MAGIC, sizeof(journal::MAGIC));
+        h->version = journal::VERSION;
+        h->headerSize = sizeof(journal::JournalHeader);
+        h->capacity = capacity;
+        h->head.store(0);
+        h->tail.store(0);
+        std::cout << "Recording events to " << path << std::endl;
+        return true;
+    }
+
+    void append(const journal::RecordKind kind, const Event &event, const int64_t scheduled = 0) {
+        const auto wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::lock_guard lock(writeMutex);
+        payload.clear();
+        nlohmann::json::to_msgpack(event.data, payload);
+        const auto typeLength = static_cast<uint8_t>(std::min<size_t>(event.type.size(), UINT8_MAX));
+        const auto size = journal::align(sizeof(journal::RecordHeader) + typeLength + payload.size());
+        if (size > header()->capacity / 2) return;
+        write({size, kind, typeLength, 0, static_cast<uint32_t>(payload.size()), 0, wallTime, scheduled}, event.type);
+    }
+};
@@ -5,21 +5,38 @@
 #ifndef EVENT_MANAGER_HPP
 #define EVENT_MANAGER_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <mutex>
 #include <queue>
 #include <typeindex>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
+#include "event_journal.hpp"
+#include "event_stats.hpp"
 #include "types.hpp"
 
 #include "../core/timeline.hpp"
+#include "../ECS/types.hpp"
 #include "../data_structures/ThreadSafePriorityQueue.hpp"
 #include "../helpers/network_helper.hpp"
 
 enum Priority { LOW, MEDIUM, HIGH };
 
+/**
+ * The thread a handler runs on. ANY handlers are called by whichever thread emits, the others only by the thread bound
+ * to that executor. Emits from any other thread are posted to the executor and run when it calls dispatch.
+ */
+enum class Executor { ANY, MAIN, NETWORK };
+
+constexpr size_t EXECUTOR_COUNT = 3;
+
 struct EventData {
     std::shared_ptr<Event> event;
     int64_t timestamp;
@@ -32,58 +49,388 @@ struct EventData {
 using EventHandler = std::function<void(std::shared_ptr<Event>)>;
 using EventTypeId = std::type_index;
 using QueuedEvent = std::shared_ptr<EventData>; // Event, timestamp, priority
+// Maps an event to the entity (or entities) it is about. Two pending events of the same type with the same key
+// are considered duplicates and only the latest one is kept in the queue
+using CoalesceKey = std::function<uint64_t(const Event &)>;
+// Turns an event into the bytes sent over the network, usually Send_Strategy::get_event
+using EventEncoder = std::function<std::string(Event &)>;
 constexpr int MAX_EVENTS = 100000;
 
+// the queue pops the earliest event first, of events due at the same time the one with the highest priority
 struct CompareQueuedEvent {
     bool operator()(const QueuedEvent &a, const QueuedEvent &b) const {
         if (a->timestamp != b->timestamp) {
-            return a < b; // Compare timestamps
+            return a->timestamp > b->timestamp;
+        }
+        return a->priority < b->priority;
+    }
+};
+
+// the timestamp of a queued event that is due the next time the queue is processed
+constexpr int64_t DUE_NOW = std::numeric_limits<int64_t>::min();
+
+/**
+ * Returned by subscribe and used to unsubscribe exactly that handler again. The slot is reused by later
+ * subscriptions, and even its table may be dropped and created again, so every subscription gets a generation no
+ * other one of the manager has and a stale handle cannot remove someone else's handler.
+ */
+struct SubscriptionHandle {
+    std::string eventType;
+    uint32_t slot = 0;
+    uint64_t generation = 0;
+    bool active = false;
+    Entity entity = INVALID_ENTITY; // set when the handler only listens to events about this entity
+};
+
+class EventManager;
+
+/**
+ * Owns a subscription and unsubscribes it when it is destroyed or reset, so a system keeping its subscriptions in
+ * members needs no cleanup of its own. Move-only.
+ */
+class ScopedSubscription {
+    EventManager *manager = nullptr;
+    SubscriptionHandle handle;
+
+public:
+    ScopedSubscription() = default;
+
+    ScopedSubscription(EventManager &manager, SubscriptionHandle handle) : manager(&manager),
+                                                                           handle(std::move(handle)) {
+    }
+
+    ScopedSubscription(ScopedSubscription &&other) noexcept : manager(std::exchange(other.manager, nullptr)),
+                                                              handle(std::move(other.handle)) {
+    }
+
+    ScopedSubscription &operator=(ScopedSubscription &&other) noexcept {
+        if (this != &other) {
+            reset();
+            manager = std::exchange(other.manager, nullptr);
+            handle = std::move(other.handle);
         }
-        return a > b; // Compare priorities
+        return *this;
+    }
+
+    ScopedSubscription(const ScopedSubscription &) = delete;
+
+    ScopedSubscription &operator=(const ScopedSubscription &) = delete;
+
+    ~ScopedSubscription() {
+        reset();
     }
+
+    inline void reset();
 };
 
 class EventManager {
 private:
-    std::unordered_map<std::string, std::vector<EventHandler> > handlers;
+    struct Subscriber {
+        EventHandler handler;
+        HandlerStats *stats;
+        EventTypeStats *typeStats;
+        Executor executor = Executor::ANY;
+        // cleared on unsubscribe so events already posted to the executor are not delivered anymore
+        mutable std::atomic<bool> subscribed{true};
+    };
+
+    using HandlerSnapshot = std::vector<std::shared_ptr<const Subscriber> >;
+
+    struct HandlerSlot {
+        std::shared_ptr<const Subscriber> handler;
+        uint64_t generation = 0; // 0 while the slot is free, no subscription gets it
+    };
+
+    /**
+     * Handlers of one event type stored in a slot map so that unsubscribing is O(1). emit iterates an immutable
+     * snapshot of the live handlers which is only rebuilt on the first emit after the table changed, so other threads
+     * can subscribe and unsubscribe while an emit is still running
+     */
+    struct HandlerTable {
+        // resolved when the table is created, so emit counts without a lookup in EventStats
+        EventTypeStats *stats = nullptr;
+        std::vector<HandlerSlot> slots;
+        std::vector<uint32_t> freeSlots;
+        std::shared_ptr<const HandlerSnapshot> snapshot = std::make_shared<const HandlerSnapshot>();
+        bool dirty = false;
+
+        const std::shared_ptr<const HandlerSnapshot> &current() {
+            if (dirty) {
+                auto rebuilt = std::make_shared<HandlerSnapshot>();
+                rebuilt->reserve(slots.size() - freeSlots.size());
+                for (const auto &slot: slots) {
+                    if (slot.handler) rebuilt->push_back(slot.handler);
+                }
+                snapshot = std::move(rebuilt);
+                dirty = false;
+            }
+            return snapshot;
+        }
+    };
+
+    std::unordered_map<std::string, HandlerTable> handlers;
+    // per entity dispatch index for handlers that only care about events addressed to one entity
+    std::unordered_map<std::string, std::unordered_map<Entity, HandlerTable> > entityHandlers;
     ThreadSafePriorityQueue<QueuedEvent, CompareQueuedEvent> eventQueue;
     std::mutex queueMutex;
     std::mutex handlersMutex;
+    // the generation of the last subscription, guarded by handlersMutex
+    uint64_t lastGeneration = 0;
+    EventStats stats;
+    // opened once at startup before other threads emit, null when journaling is off
+    std::unique_ptr<EventJournal> journal;
+    // set once at startup, events are sent as JSON without one
+    EventEncoder encoder;
+
+    // what the queue keeps for an event type
+    struct QueuedType {
+        EventTypeStats *stats = nullptr;
+        // set for coalescible types, see setCoalescible
+        CoalesceKey key;
+        // the pending event of every key of a coalescible type
+        std::unordered_map<uint64_t, QueuedEvent> pending;
+    };
+
+    // guarded by queueMutex
+    std::unordered_map<std::string, QueuedType> queuedTypes;
+
+    // must be called with queueMutex held
+    QueuedType &queuedType(const std::string &type) {
+        auto &queued = queuedTypes[type];
+        if (queued.stats == nullptr) queued.stats = &stats.forType(type);
+        return queued;
+    }
+
+    // must be called with handlersMutex held
+    HandlerTable &handlerTable(const std::string &type) {
+        auto &table = handlers[type];
+        if (table.stats == nullptr) table.stats = &stats.forType(type);
+        return table;
+    }
+
+    // events waiting for the thread of an executor, indexed by Executor
+    struct Mailbox {
+        std::mutex mutex;
+        std::vector<std::pair<std::shared_ptr<const Subscriber>, std::shared_ptr<Event> > > pending;
+    };
+
+    std::array<Mailbox, EXECUTOR_COUNT> mailboxes;
+
+    static Executor &threadExecutor() {
+        thread_local Executor executor = Executor::ANY;
+        return executor;
+    }
+
+    void invoke(const Subscriber &subscriber, const std::shared_ptr<Event> &event) {
+        const auto start = EventStats::Clock::now();
+        subscriber.handler(std::make_shared<Event>(*event));
+        stats.handlerCalled(subscriber.stats, event->type, start, EventStats::Clock::now());
+        subscriber.typeStats->invocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // payload fields that address an event to an entity
+    static constexpr std::array<const char *, 5> ENTITY_FIELDS = {
+        "entity", "entityA", "entityB", "triggerEntity", "otherEntity"
+    };
+
+    static std::vector<Entity> targetsOf(const Event &event) {
+        std::vector<Entity> targets;
+        if (!event.data.is_object()) return targets;
+        for (const auto *field: ENTITY_FIELDS) {
+            const auto it = event.data.find(field);
+            if (it == event.data.end() || !it->is_number_integer()) continue;
+            const auto entity = it->get<Entity>();
+            if (std::find(targets.begin(), targets.end(), entity) == targets.end()) {
+                targets.push_back(entity);
+            }
+        }
+        return targets;
+    }
+
+    SubscriptionHandle addHandler(HandlerTable &table, const EventHandler &handler, const std::string &eventType,
+                                  const Entity entity, const Executor executor) {
+        uint32_t index;
+        if (table.freeSlots.empty()) {
+            index = static_cast<uint32_t>(table.slots.size());
+            table.slots.emplace_back();
+        } else {
+            index = table.freeSlots.back();
+            table.freeSlots.pop_back();
+        }
+        auto &slot = table.slots[index];
+        slot.generation = ++lastGeneration;
+        const auto subscriber = std::make_shared<Subscriber>();
+        subscriber->handler = handler;
+        subscriber->stats = stats.addHandler(eventType, EventStats::handlerName(handler.target_type()));
+        subscriber->typeStats = &stats.forType(eventType);
+        subscriber->executor = executor;
+        slot.handler = subscriber;
+        table.dirty = true;
+        return {eventType, index, slot.generation, true, entity};
+    }
+
+    static void removeHandler(HandlerTable &table, const SubscriptionHandle &handle) {
+        if (handle.slot >= table.slots.size() || table.slots[handle.slot].generation != handle.generation) {
+            return;
+        }
+        auto &slot = table.slots[handle.slot];
+        slot.handler->subscribed = false;
+        slot.handler.reset();
+        slot.generation = 0;
+        table.freeSlots.push_back(handle.slot);
+        table.dirty = true;
+    }
+
+    static uint64_t entityKey(const Event &event) {
+        return event.data.at("entity").get<uint64_t>();
+    }
+
+    // must be called with queueMutex held
+    void releaseCoalesced(const QueuedEvent &queuedEvent) {
+        const auto it = queuedTypes.find(queuedEvent->event->type);
+        if (it == queuedTypes.end() || !it->second.key) return;
+        auto &pending = it->second.pending;
+        const auto key = it->second.key(*queuedEvent->event);
+        if (const auto found = pending.find(key); found != pending.end() && found->second == queuedEvent) {
+            pending.erase(found);
+        }
+    }
 
 public:
-    void subscribe(const EventHandler &handler, const std::string &eventType) {
+    /**
+     * Marks an event type as coalescible. While an event of this type is waiting in the queue, queueing another one
+     * with the same key replaces the payload of the pending event instead of adding a new entry.
+     * @param eventType The event type to coalesce
+     * @param key Extracts the key from the event. Defaults to the "entity" field of the event data
+     */
+    void setCoalescible(const std::string &eventType, CoalesceKey key = nullptr) {
+        std::lock_guard lock(queueMutex);
+        queuedType(eventType).key = key ? std::move(key) : entityKey;
+    }
+
+    /**
+     * Binds the calling thread to an executor. Handlers registered for that executor are called directly when this
+     * thread emits and receive the events posted by other threads when this thread calls dispatch.
+     */
+    static void bindThread(const Executor executor) {
+        threadExecutor() = executor;
+    }
+
+    SubscriptionHandle subscribe(const EventHandler &handler, const std::string &eventType,
+                                 const Executor executor = Executor::ANY) {
+        std::lock_guard lock(handlersMutex);
+        return addHandler(handlerTable(eventType), handler, eventType, INVALID_ENTITY, executor);
+    }
+
+    /**
+     * Subscribes a handler that is only called for events addressed to the given entity, i.e. events whose payload
+     * names the entity in one of its entity fields. The cost of emitting such an event depends on the number of
+     * handlers listening to that entity rather than on every subscriber of the type.
+     */
+    SubscriptionHandle subscribe(const EventHandler &handler, const std::string &eventType, const Entity entity,
+                                 const Executor executor = Executor::ANY) {
         std::lock_guard lock(handlersMutex);
-        handlers[eventType].push_back(handler);
+        return addHandler(entityHandlers[eventType][entity], handler, eventType, entity, executor);
     }
 
-    void unsubscribe(const EventHandler handler, const std::string &eventType) {
+    /**
+     * Removes the handler the handle was issued for. A handler that is being called by an emit running on another
+     * thread finishes that call, after that it is never called again.
+     */
+    void unsubscribe(SubscriptionHandle &handle) {
+        if (!handle.active) return;
         std::lock_guard lock(handlersMutex);
-        if (!handlers.contains(eventType)) {
+        handle.active = false;
+        if (handle.entity != INVALID_ENTITY) {
+            const auto it = entityHandlers.find(handle.eventType);
+            if (it == entityHandlers.end()) return;
+            if (const auto table = it->second.find(handle.entity); table != it->second.end()) {
+                removeHandler(table->second, handle);
+                // entities come and go, an index entry must not outlive the last handler of its entity
+                if (table->second.slots.size() == table->second.freeSlots.size()) {
+                    it->second.erase(table);
+                    if (it->second.empty()) entityHandlers.erase(it);
+                }
+            }
+            return;
+        }
+        const auto it = handlers.find(handle.eventType);
+        if (it == handlers.end()) {
             std::cerr << "Error: Invalid eventType" << std::endl;
             return;
         }
-        auto &eventHandlers = handlers[eventType];
-        // Basic remove implementation for now
-        std::erase_if(eventHandlers,
-                      [&handler](const EventHandler &h) {
-                          return h.target_type() == handler.target_type();
-                      });
+        removeHandler(it->second, handle);
     }
 
     // use for immediate event processing
     void emit(const std::shared_ptr<Event> &event) {
-        auto typeId = std::type_index(typeid(event->type));
-        if (handlers.contains(event->type)) {
-            for (auto &handler: handlers[event->type]) {
-                handler(std::make_shared<Event>(*event));
+        if (journal) journal->append(journal::EMITTED, *event);
+        EventTypeStats *typeStats;
+        std::vector<std::shared_ptr<const HandlerSnapshot> > snapshots; {
+            std::lock_guard lock(handlersMutex);
+            // every type emitted gets a table, possibly empty, that holds its stats
+            auto &table = handlerTable(event->type);
+            typeStats = table.stats;
+            if (const auto &snapshot = table.current(); !snapshot->empty()) snapshots.push_back(snapshot);
+            if (const auto it = entityHandlers.find(event->type); it != entityHandlers.end()) {
+                for (const auto entity: targetsOf(*event)) {
+                    if (const auto table = it->second.find(entity); table != it->second.end()) {
+                        snapshots.push_back(table->second.current());
+                    }
+                }
+            }
+        }
+        typeStats->emitted.fetch_add(1, std::memory_order_relaxed);
+        if (snapshots.empty()) return;
+        const auto emitStart = EventStats::Clock::now();
+        const auto current = threadExecutor();
+        for (const auto &snapshot: snapshots) {
+            for (const auto &subscriber: *snapshot) {
+                // the snapshot may predate an unsubscribe, like dispatch skip handlers that were removed since
+                if (!subscriber->subscribed) continue;
+                if (subscriber->executor == Executor::ANY || subscriber->executor == current) {
+                    invoke(*subscriber, event);
+                    continue;
+                }
+                auto &mailbox = mailboxes[static_cast<size_t>(subscriber->executor)];
+                std::lock_guard lock(mailbox.mutex);
+                mailbox.pending.emplace_back(subscriber, event);
             }
         }
+        typeStats->latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            EventStats::Clock::now() - emitStart).count());
     }
 
     void emitToServer(zmq::socket_t& socket, const std::shared_ptr<Event> &event) {
+        if (journal) journal->append(journal::SENT, *event);
+        if (encoder) {
+            const auto start = NetworkStats::Clock::now();
+            auto encoded = encoder(*event);
+            networkStats().encoded("event", start);
+            NetworkHelper::sendMessageClient(socket, NetworkHelper::EVENT_ENTITY_ID, encoded);
+            return;
+        }
         NetworkHelper::sendEventClient(socket, event);
     }
 
+    // sends the events as one EVENT_BATCH_ID message, the server handles them in order as if sent one by one
+    void emitToServer(zmq::socket_t &socket, const std::vector<std::shared_ptr<Event> > &events) {
+        std::string batch;
+        const auto start = NetworkStats::Clock::now();
+        for (const auto &event: events) {
+            if (journal) journal->append(journal::SENT, *event);
+            if (encoder) {
+                NetworkHelper::appendBatchedEvent(batch, encoder(*event));
+                continue;
+            }
+            nlohmann::json eventJson;
+            to_json(eventJson, *event);
+            NetworkHelper::appendBatchedEvent(batch, eventJson.dump());
+        }
+        networkStats().encoded("event", start);
+        NetworkHelper::sendMessageClient(socket, NetworkHelper::EVENT_BATCH_ID, batch);
+    }
+
     void receiveFromServer(zmq::socket_t socket) {
         std::shared_ptr<Event> event;
         NetworkHelper::receiveEventClient(socket, event);
@@ -92,18 +439,59 @@ public:
 
 
     void queueEvent(const std::shared_ptr<EventData>& event) {
+        if (journal) journal->append(journal::QUEUED, *event->event, event->timestamp);
+        std::lock_guard lock(queueMutex);
+        auto &queued = queuedType(event->event->type);
+        uint64_t key = 0;
+        if (queued.key) {
+            key = queued.key(*event->event);
+            if (const auto it = queued.pending.find(key); it != queued.pending.end()) {
+                // the older event keeps its place in the queue but now carries the latest payload
+                it->second->event = event->event;
+                queued.stats->coalesced.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
         if(eventQueue.size() > MAX_EVENTS) {
+            queued.stats->dropped.fetch_add(1, std::memory_order_relaxed);
             std::cout << "We cannot raise more events since event queue is full!!!" << std::endl;
             return;
         }
+        queued.stats->queued.fetch_add(1, std::memory_order_relaxed);
+        if (queued.key) {
+            queued.pending[key] = event;
+        }
         eventQueue.push(event);
     }
 
+    /**
+     * Emits the event right away unless its type is coalescible, then it is queued to be emitted the next time the
+     * queue is processed and replaces a pending event with the same key. For events sent every frame of which only
+     * the latest matters.
+     */
+    void post(const std::shared_ptr<Event> &event) {
+        bool coalesce; {
+            std::lock_guard lock(queueMutex);
+            const auto it = queuedTypes.find(event->type);
+            coalesce = it != queuedTypes.end() && it->second.key;
+        }
+        if (!coalesce) {
+            emit(event);
+            return;
+        }
+        queueEvent(std::make_shared<EventData>(event, DUE_NOW, Priority::MEDIUM));
+    }
+
     void processEventQueue(int64_t time) {
         QueuedEvent queuedEvent;
         while(eventQueue.pop(queuedEvent)) {
             if(queuedEvent->timestamp <= time) {
-                emit(queuedEvent->event);
+                std::shared_ptr<Event> event; {
+                    std::lock_guard lock(queueMutex);
+                    releaseCoalesced(queuedEvent);
+                    event = queuedEvent->event;
+                }
+                emit(event);
             } else {
                 eventQueue.push(queuedEvent); // Reinsert if not ready to process
                 break;
@@ -111,11 +499,51 @@ public:
         }
     }
 
+    /**
+     * Runs the handlers of the events other threads posted to this executor, in the order they were emitted. Must be
+     * called from the thread bound to the executor.
+     */
+    void dispatch(const Executor executor) {
+        auto &mailbox = mailboxes[static_cast<size_t>(executor)];
+        std::vector<std::pair<std::shared_ptr<const Subscriber>, std::shared_ptr<Event> > > pending; {
+            std::lock_guard lock(mailbox.mutex);
+            pending.swap(mailbox.pending);
+        }
+        for (const auto &[subscriber, event]: pending) {
+            if (!subscriber->subscribed) continue;
+            invoke(*subscriber, event);
+        }
+    }
+
+    void setEventEncoder(EventEncoder eventEncoder) {
+        encoder = std::move(eventEncoder);
+    }
+
+    bool openJournal(const std::string &path, const uint64_t capacity = journal::DEFAULT_CAPACITY) {
+        auto opened = std::make_unique<EventJournal>();
+        if (!opened->open(path, capacity)) return false;
+        journal = std::move(opened);
+        return true;
+    }
+
+    EventStats &getStats() {
+        return stats;
+    }
+
     void clearQueue() {
+        std::lock_guard lock(queueMutex);
         eventQueue.clear();
+        for (auto &[type, queued]: queuedTypes) {
+            queued.pending.clear();
+        }
     }
 
 
 };
 
+inline void ScopedSubscription::reset() {
+    if (manager != nullptr) manager->unsubscribe(handle);
+    manager = nullptr;
+}
+
 #endif //EVENT_MANAGER_HPP
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+/**
+ * Log-linear histogram of durations in nanoseconds. Every power of two is split in 8 buckets so percentiles are
+ * accurate to about 12%. Recording is a single relaxed atomic increment and never allocates.
+ */
+class LatencyHistogram {
+    static constexpr int SUB_BUCKETS = 8;
+    static constexpr int SUB_BITS = 3;
+    static constexpr int BUCKETS = 64 * SUB_BUCKETS;
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> count{0};
+
+    static int bucketOf(const uint64_t nanos) {
+        if (nanos < SUB_BUCKETS) return static_cast<int>(nanos);
+        const int exponent = std::bit_width(nanos) - 1;
+        const auto sub = static_cast<int>((nanos >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+        return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    // upper bound of the values that land in the bucket
+    static uint64_t valueOf(const int bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        const int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+        const uint64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (exponent - SUB_BITS)) - 1;
+    }
+
+public:
+    void record(const uint64_t nanos) {
+        buckets[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t total() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    // returns the duration in nanoseconds below which the given fraction (0..1) of the samples fall
+    [[nodiscard]] uint64_t percentile(const double fraction) const {
+        const uint64_t samples = total();
+        if (samples == 0) return 0;
+        const auto wanted = static_cast<uint64_t>(fraction * static_cast<double>(samples - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= wanted) return valueOf(i);
+        }
+        return valueOf(BUCKETS - 1);
+    }
+
+    void reset() {
+        for (auto &bucket: buckets) bucket.store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+    }
+};
+
+struct HandlerStats {
+    std::string name;
+    std::atomic<uint64_t> invocations{0};
+    LatencyHistogram latency;
+};
+
+struct EventTypeStats {
+    std::atomic<uint64_t> emitted{0};
+    std::atomic<uint64_t> queued{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> invocations{0};
+    // time spent in all handlers of one emit
+    LatencyHistogram latency;
+    std::vector<std::unique_ptr<HandlerStats> > handlers;
+};
+
+/**
+ * Counters and handler timings for every event type. Always on, the dump can be printed at any time. On top of that a
+ * Chrome trace (chrome://tracing or https://ui.perfetto.dev) of every handler call can be recorded between
+ * startTrace and stopTrace. forType and addHandler lock and look the type up, they are meant to be called once per
+ * type or handler, the stats they return stay where they are and are counted with relaxed atomics.
+ */
+class EventStats {
+    struct TraceEvent {
+        const HandlerStats *handler;
+        std::string type;
+        int64_t start;
+        uint64_t duration;
+        size_t thread;
+    };
+
+    static constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<EventTypeStats> > types;
+    std::atomic<uint64_t> frames{0};
+
+    std::atomic<bool> tracing{false};
+    std::mutex traceMutex;
+    std::vector<TraceEvent> trace;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    static std::string demangle(const char *name) {
+#if defined(__GNUG__)
+        int status = 0;
+        std::unique_ptr<char, void(*)(void *)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status),
+                                                         std::free);
+        if (status == 0 && demangled) return demangled.get();
+#endif
+        return name;
+    }
+
+    static std::string formatNanos(const uint64_t nanos) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << static_cast<double>(nanos) / 1000.0 << "us";
+        return out.str();
+    }
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Names a handler after the member it was declared in, e.g. "CollisionHandlerSystem::collisionHandler"
+     */
+    static std::string handlerName(const std::type_info &type) {
+        auto name = demangle(type.name());
+        for (const auto *marker: {"::{lambda", "::'lambda", "::$_"}) {
+            if (const auto pos = name.find(marker); pos != std::string::npos) {
+                return name.substr(0, pos);
+            }
+        }
+        return name;
+    }
+
+    EventTypeStats &forType(const std::string &type) {
+        std::lock_guard lock(mutex);
+        auto &stats = types[type];
+        if (!stats) stats = std::make_unique<EventTypeStats>();
+        return *stats;
+    }
+
+    HandlerStats *addHandler(const std::string &type, const std::string &name) {
+        auto &typeStats = forType(type);
+        std::lock_guard lock(mutex);
+        for (const auto &handler: typeStats.handlers) {
+            if (handler->name == name) return handler.get();
+        }
+        typeStats.handlers.push_back(std::make_unique<HandlerStats>());
+        typeStats.handlers.back()->name = name;
+        return typeStats.handlers.back().get();
+    }
+
+    void frame() {
+        frames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void handlerCalled(HandlerStats *handler, const std::string &type, const Clock::time_point start,
+                       const Clock::time_point end) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        const auto nanos = static_cast<uint64_t>(std::max<int64_t>(0, elapsed));
+        handler->invocations.fetch_add(1, std::memory_order_relaxed);
+        handler->latency.record(nanos);
+        if (!tracing.load(std::memory_order_relaxed)) return;
+        std::lock_guard lock(traceMutex);
+        if (trace.size() >= MAX_TRACE_EVENTS) return;
+        trace.push_back({
+            handler, type, std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count(), nanos,
+            std::hash<std::thread::id>{}(std::this_thread::get_id())
+        });
+    }
+
+    void startTrace() {
+        std::lock_guard lock(traceMutex);
+        trace.clear();
+        trace.reserve(MAX_TRACE_EVENTS / 16);
+        tracing = true;
+    }
+
+    [[nodiscard]] bool isTracing() const {
+        return tracing;
+    }
+
+    /**
+     * Stops recording and writes the trace in the Chrome trace event format
+     */
+    void stopTrace(const std::string &path) {
+        tracing = false;
+        std::lock_guard lock(traceMutex);
+        nlohmann::json events = nlohmann::json::array();
+        for (const auto &[handler, type, start, duration, thread]: trace) {
+            events.push_back({
+                {"name", handler->name}, {"cat", type}, {"ph", "X"}, {"ts", static_cast<double>(start) / 1000.0},
+                {"dur", static_cast<double>(duration) / 1000.0}, {"pid", 0}, {"tid", thread % 100000}
+            });
+        }
+        std::ofstream file(path);
+        file << nlohmann::json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump();
+        std::cout << "Wrote " << trace.size() << " handler calls to " << path << std::endl;
+        trace.clear();
+    }
+
+    void dump(std::ostream &out) const {
+        std::lock_guard lock(mutex);
+        const auto frameCount = std::max<uint64_t>(1, frames.load());
+        out << "Event stats over " << frameCount << " frames" << std::endl;
+        out << std::left << std::setw(44) << "type / handler" << std::right << std::setw(10) << "emitted"
+                << std::setw(10) << "/frame" << std::setw(10) << "queued" << std::setw(10) << "dropped"
+                << std::setw(10) << "merged" << std::setw(10) << "calls" << std::setw(12) << "p50"
+                << std::setw(12) << "p99" << std::endl;
+        for (const auto &[type, stats]: types) {
+            out << std::left << std::setw(44) << type << std::right << std::setw(10) << stats->emitted
+                    << std::setw(10) << std::fixed << std::setprecision(2)
+                    << static_cast<double>(stats->emitted) / static_cast<double>(frameCount)
+                    << std::setw(10) << stats->queued << std::setw(10) << stats->dropped
+                    << std::setw(10) << stats->coalesced << std::setw(10) << stats->invocations
+                    << std::setw(12) << formatNanos(stats->latency.percentile(0.5))
+                    << std::setw(12) << formatNanos(stats->latency.percentile(0.99)) << std::endl;
+            for (const auto &handler: stats->handlers) {
+                out << std::left << std::setw(44) << ("  " + handler->name) << std::right << std::setw(60)
+                        << handler->invocations
+                        << std::setw(12) << formatNanos(handler->latency.percentile(0.5))
+                        << std::setw(12) << formatNanos(handler->latency.percentile(0.99)) << std::endl;
+            }
+        }
+    }
+};
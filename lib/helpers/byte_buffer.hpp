@@ -0,0 +1,144 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/**
+ * Little endian writer for the binary wire format. Appends to a std::string so the result can be handed to
+ * zmq::buffer or stored like the JSON messages.
+ */
+class ByteWriter {
+    std::string &out;
+
+public:
+    explicit ByteWriter(std::string &out) : out(out) {
+    }
+
+    void u8(const uint8_t value) {
+        out.push_back(static_cast<char>(value));
+    }
+
+    void u16(const uint16_t value) {
+        u8(static_cast<uint8_t>(value));
+        u8(static_cast<uint8_t>(value >> 8));
+    }
+
+    void u32(const uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) u8(static_cast<uint8_t>(value >> shift));
+    }
+
+    void f32(const float value) {
+        u32(std::bit_cast<uint32_t>(value));
+    }
+
+    // 7 bits per byte, high bit set while more bytes follow
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            u8(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        u8(static_cast<uint8_t>(value));
+    }
+
+    // zigzag so that small negative numbers stay small
+    void svarint(const int64_t value) {
+        varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    void string(const std::string_view value) {
+        varint(value.size());
+        out.append(value);
+    }
+
+    void bytes(const void *data, const size_t size) {
+        out.append(static_cast<const char *>(data), size);
+    }
+
+    [[nodiscard]] size_t size() const {
+        return out.size();
+    }
+};
+
+/**
+ * Reads what ByteWriter wrote. Throws std::runtime_error when the message is shorter than its contents claim.
+ */
+class ByteReader {
+    const uint8_t *data;
+    size_t length;
+    size_t position = 0;
+
+    void need(const size_t count) const {
+        if (length - position < count) {
+            throw std::runtime_error("Truncated binary message");
+        }
+    }
+
+public:
+    ByteReader(const void *data, const size_t length) : data(static_cast<const uint8_t *>(data)), length(length) {
+    }
+
+    uint8_t u8() {
+        need(1);
+        return data[position++];
+    }
+
+    uint16_t u16() {
+        need(2);
+        const auto value = static_cast<uint16_t>(data[position] | data[position + 1] << 8);
+        position += 2;
+        return value;
+    }
+
+    uint32_t u32() {
+        need(4);
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(data[position + i]) << (8 * i);
+        position += 4;
+        return value;
+    }
+
+    float f32() {
+        return std::bit_cast<float>(u32());
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = u8();
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        throw std::runtime_error("Malformed varint");
+    }
+
+    int64_t svarint() {
+        const uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    std::string string() {
+        const auto size = varint();
+        need(size);
+        std::string value(reinterpret_cast<const char *>(data + position), size);
+        position += size;
+        return value;
+    }
+
+    // the unread rest of the message
+    [[nodiscard]] std::string_view rest() const {
+        return {reinterpret_cast<const char *>(data + position), length - position};
+    }
+
+    void skip(const size_t count) {
+        need(count);
+        position += count;
+    }
+
+    [[nodiscard]] bool done() const {
+        return position == length;
+    }
+};
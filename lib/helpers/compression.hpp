@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "byte_buffer.hpp"
+
+/**
+ * Payload compression used by NetworkHelper. Every payload frame is preceded by a one byte frame holding its Codec.
+ * The codec is a small LZ77: the output is the varint size of the payload followed by tokens of
+ *   varint literal count | literals | varint offset | varint match length - MIN_MATCH
+ * where an offset of 0 ends the payload. With a dictionary the payload is compressed as if the dictionary came right
+ * before it, so even short messages find their field names and structure in it. The dictionary is trained from sample
+ * payloads both sides generate the same way (see Strategy::samplePayloads) and identified by a hash, a receiver with a
+ * different dictionary refuses the payload instead of decoding garbage.
+ */
+namespace Compression {
+    enum Codec : uint8_t {
+        RAW = 0,
+        LZ = 1,
+        LZ_DICTIONARY = 2,
+    };
+
+    struct Settings {
+        Codec codec = LZ; // RAW turns compression off
+        size_t threshold = 64; // payloads shorter than this are sent as they are
+    };
+
+    struct Stats {
+        std::atomic<uint64_t> payloads{0};
+        std::atomic<uint64_t> compressed{0};
+        std::atomic<uint64_t> bytesIn{0};
+        std::atomic<uint64_t> bytesOut{0};
+        std::atomic<uint64_t> compressNanos{0};
+        std::atomic<uint64_t> decompressNanos{0};
+    };
+
+    struct Dictionary {
+        std::string content;
+        uint32_t id = 0;
+        // the match table with every position of the content, copied for each payload instead of being rebuilt
+        std::vector<int32_t> table;
+    };
+
+    struct Packed {
+        Codec codec;
+        std::string body;
+    };
+
+    // set up once before any socket is used
+    inline Settings &settings() {
+        static Settings settings;
+        return settings;
+    }
+
+    inline Dictionary &dictionary() {
+        static Dictionary dictionary;
+        return dictionary;
+    }
+
+    inline Stats &stats() {
+        static Stats stats;
+        return stats;
+    }
+
+    namespace detail {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 1 << 16;
+        constexpr int MAX_HASH_BITS = 12;
+        constexpr size_t MAX_SIZE = 1 << 26;
+
+        inline uint32_t read32(const char *data) {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        inline uint32_t hash(const uint32_t value, const int bits) {
+            return value * 2654435761u >> (32 - bits);
+        }
+
+        // a table about the size of the input, clearing a large one would cost more than compressing a short message
+        inline int hashBits(const size_t size) {
+            return std::clamp(static_cast<int>(std::bit_width(size)), 8, MAX_HASH_BITS);
+        }
+
+        inline std::vector<int32_t> prime(const std::string_view prefix) {
+            std::vector<int32_t> table(1 << MAX_HASH_BITS, -1);
+            for (size_t i = 0; i + MIN_MATCH <= prefix.size(); i++) {
+                table[hash(read32(prefix.data() + i), MAX_HASH_BITS)] = static_cast<int32_t>(i);
+            }
+            return table;
+        }
+
+        inline uint32_t fnv1a(const std::string_view data) {
+            uint32_t hash = 2166136261u;
+            for (const char c: data) {
+                hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+            }
+            return hash;
+        }
+
+        inline int64_t nanosSince(const std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+
+        // table is the one prime built for the prefix, or empty without one
+        inline void compress(const std::string_view input, const std::string_view prefix, std::vector<int32_t> table,
+                             std::string &out) {
+            std::string buffer;
+            buffer.reserve(prefix.size() + input.size());
+            buffer.append(prefix);
+            buffer.append(input);
+            const char *data = buffer.data();
+            const size_t end = buffer.size();
+
+            ByteWriter writer(out);
+            writer.varint(input.size());
+            const int bits = table.empty() ? hashBits(input.size()) : MAX_HASH_BITS;
+            if (table.empty()) table.assign(1 << bits, -1);
+
+            size_t anchor = prefix.size();
+            size_t position = anchor;
+            while (position + MIN_MATCH <= end) {
+                const auto slot = hash(read32(data + position), bits);
+                const int32_t candidate = table[slot];
+                table[slot] = static_cast<int32_t>(position);
+                if (candidate < 0 || position - candidate > MAX_OFFSET ||
+                    read32(data + candidate) != read32(data + position)) {
+                    position++;
+                    continue;
+                }
+                size_t length = MIN_MATCH;
+                while (position + length < end && data[candidate + length] == data[position + length]) length++;
+
+                writer.varint(position - anchor);
+                writer.bytes(data + anchor, position - anchor);
+                writer.varint(position - candidate);
+                writer.varint(length - MIN_MATCH);
+                position += length;
+                anchor = position;
+            }
+            writer.varint(end - anchor);
+            writer.bytes(data + anchor, end - anchor);
+            writer.varint(0);
+        }
+
+        inline std::string decompress(const std::string_view body, const std::string_view prefix) {
+            ByteReader reader(body.data(), body.size());
+            const auto size = reader.varint();
+            if (size > MAX_SIZE) throw std::runtime_error("Corrupt compressed payload");
+            std::string out(prefix.size() + size, '\0');
+            prefix.copy(out.data(), prefix.size());
+            size_t position = prefix.size();
+            while (true) {
+                const auto literals = reader.varint();
+                const auto rest = reader.rest();
+                reader.skip(literals);
+                if (literals > out.size() - position) throw std::runtime_error("Corrupt compressed payload");
+                std::memcpy(out.data() + position, rest.data(), literals);
+                position += literals;
+                const auto offset = reader.varint();
+                if (offset == 0) break;
+                const auto length = reader.varint() + MIN_MATCH;
+                if (offset > position || length > out.size() - position) {
+                    throw std::runtime_error("Corrupt compressed payload");
+                }
+                char *to = out.data() + position;
+                const char *from = to - offset;
+                if (offset >= length) {
+                    std::memcpy(to, from, length);
+                } else {
+                    // the match overlaps what it is copying
+                    for (size_t i = 0; i < length; i++) to[i] = from[i];
+                }
+                position += length;
+            }
+            if (position != out.size()) throw std::runtime_error("Corrupt compressed payload");
+            out.erase(0, prefix.size());
+            return out;
+        }
+    }
+
+    /**
+     * Builds a dictionary out of the parts that repeat across the samples. Every sample is cut into segments that are
+     * scored by how many other samples contain their 8 byte sequences. The best segment is taken, the sequences it
+     * contains no longer count for the others and this repeats until the dictionary is full, so it holds the common
+     * structure once rather than many variations of the most common part.
+     */
+    inline Dictionary trainDictionary(const std::vector<std::string> &samples, const size_t maxSize = 2048) {
+        constexpr size_t GRAM = 8;
+        constexpr size_t SEGMENT = 32;
+        std::unordered_map<std::string_view, int> counts;
+        for (const auto &sample: samples) {
+            std::unordered_map<std::string_view, bool> seen;
+            for (size_t i = 0; i + GRAM <= sample.size(); i++) {
+                const std::string_view gram(sample.data() + i, GRAM);
+                if (seen.try_emplace(gram, true).second) counts[gram]++;
+            }
+        }
+
+        std::vector<std::string_view> segments;
+        for (const auto &sample: samples) {
+            for (size_t start = 0; start + GRAM <= sample.size(); start += GRAM) {
+                segments.emplace_back(sample.data() + start, std::min(SEGMENT, sample.size() - start));
+            }
+        }
+        const auto score = [&counts](const std::string_view segment) {
+            int total = 0;
+            for (size_t i = 0; i + GRAM <= segment.size(); i++) {
+                total += std::max(counts[segment.substr(i, GRAM)] - 1, 0);
+            }
+            return total;
+        };
+
+        std::vector<std::string_view> chosen;
+        size_t size = 0;
+        while (true) {
+            int best = 0;
+            auto bestSegment = segments.end();
+            for (auto it = segments.begin(); it != segments.end(); ++it) {
+                if (size + it->size() > maxSize) continue;
+                if (const int total = score(*it); total > best) {
+                    best = total;
+                    bestSegment = it;
+                }
+            }
+            if (bestSegment == segments.end()) break;
+            for (size_t i = 0; i + GRAM <= bestSegment->size(); i++) {
+                counts[bestSegment->substr(i, GRAM)] = 0;
+            }
+            chosen.push_back(*bestSegment);
+            size += bestSegment->size();
+            segments.erase(bestSegment);
+        }
+        // the best segments go last, closest to the payload
+        Dictionary dictionary;
+        for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) dictionary.content.append(*it);
+        dictionary.id = detail::fnv1a(dictionary.content);
+        dictionary.table = detail::prime(dictionary.content);
+        return dictionary;
+    }
+
+    /**
+     * Reads SHADE_COMPRESSION (off, lz or dictionary, default lz) and SHADE_COMPRESSION_THRESHOLD (bytes, default 64).
+     * Only the sender's setting matters, any receiver decodes every codec.
+     */
+    inline void configureFromEnvironment() {
+        if (const char *codec = std::getenv("SHADE_COMPRESSION")) {
+            const std::string name(codec);
+            settings().codec = name == "off" ? RAW : name == "dictionary" ? LZ_DICTIONARY : LZ;
+        }
+        if (const char *threshold = std::getenv("SHADE_COMPRESSION_THRESHOLD")) {
+            settings().threshold = std::strtoul(threshold, nullptr, 10);
+        }
+    }
+
+    // the compressed payload, or nothing when it should be sent as it is
+    inline std::optional<Packed> pack(const std::string_view payload) {
+        auto &stats = Compression::stats();
+        stats.payloads++;
+        stats.bytesIn += payload.size();
+        const auto codec = settings().codec;
+        if (codec == RAW || payload.size() < settings().threshold) {
+            stats.bytesOut += payload.size();
+            return std::nullopt;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        Packed packed{codec, {}};
+        packed.body.reserve(payload.size() / 2 + 16);
+        if (codec == LZ_DICTIONARY) {
+            ByteWriter(packed.body).u32(dictionary().id);
+            detail::compress(payload, dictionary().content, dictionary().table, packed.body);
+        } else {
+            detail::compress(payload, {}, {}, packed.body);
+        }
+        stats.compressNanos += detail::nanosSince(start);
+        if (packed.body.size() >= payload.size()) {
+            stats.bytesOut += payload.size();
+            return std::nullopt;
+        }
+        stats.compressed++;
+        stats.bytesOut += packed.body.size();
+        return packed;
+    }
+
+    // the payload a non RAW frame was packed from, throws std::runtime_error if it can not be decoded
+    inline std::string unpack(const Codec codec, const std::string_view body) {
+        const auto start = std::chrono::steady_clock::now();
+        std::string payload;
+        if (codec == LZ) {
+            payload = detail::decompress(body, {});
+        } else if (codec == LZ_DICTIONARY) {
+            ByteReader reader(body.data(), body.size());
+            if (reader.u32() != dictionary().id) throw std::runtime_error("Compressed with a different dictionary");
+            payload = detail::decompress(reader.rest(), dictionary().content);
+        } else {
+            throw std::runtime_error("Unknown compression codec");
+        }
+        stats().decompressNanos += detail::nanosSince(start);
+        return payload;
+    }
+
+    inline std::string summary() {
+        const auto &stats = Compression::stats();
+        const double in = static_cast<double>(stats.bytesIn);
+        const double out = static_cast<double>(stats.bytesOut);
+        return std::to_string(stats.payloads.load()) + " payloads, " + std::to_string(stats.compressed.load()) +
+               " compressed, " + std::to_string(stats.bytesIn.load()) + " -> " + std::to_string(stats.bytesOut.load()) +
+               " bytes (" + std::to_string(in > 0 ? out / in : 1.0) + "), " +
+               std::to_string(stats.compressNanos.load() / 1000000) + " ms compressing, " +
+               std::to_string(stats.decompressNanos.load() / 1000000) + " ms decompressing";
+    }
+}
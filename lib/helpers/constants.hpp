@@ -8,6 +8,7 @@
 namespace engine_constants {
     constexpr float FRAME_RATE = 1.f / 60.f;
     constexpr int SERVER_CONNECT_PORT = 5555;
+    constexpr int INTERPOLATION_DELAY = 100; // milliseconds remote entities are shown behind their updates
 }
 
 #endif //CONSTANTS_HPP
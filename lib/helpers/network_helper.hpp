@@ -4,71 +4,242 @@
 
 #pragma once
 
+#include <iostream>
 #include <zmq.hpp>
 
+#include "byte_buffer.hpp"
+#include "compression.hpp"
+#include "network_stats.hpp"
 #include "../ECS/types.hpp"
+#include "../EMS/types.hpp"
 
 
 namespace NetworkHelper {
     const std::string EVENT_ENTITY_ID = "ThisIsAnEvent";
+    // several events of a client in one message, each as varint length | the event as EVENT_ENTITY_ID would carry it
+    const std::string EVENT_BATCH_ID = "ThisIsABatch";
+    // everything the server sends a client in one tick, see SnapshotFrame
+    const std::string SNAPSHOT_ID = "ThisIsASnapshot";
+    // the client acknowledging Transform deltas
+    const std::string ACK_ID = "ThisIsAnAck";
+    // a client measuring its round trip time, the server sends the payload back as a PONG_ID
+    const std::string PING_ID = "ThisIsAPing";
+    const std::string PONG_ID = "ThisIsAPong";
+    // a client leaving, the server deletes its entities on the other clients
+    const std::string DISCONNECT_ID = "ThisIsAGoodbye";
+
+    // the message type NetworkStats counts a message under, all entity messages count as one
+    inline NetworkStats::MessageType typeOf(const std::string_view entity_id) {
+        if (entity_id == EVENT_ENTITY_ID) return NetworkStats::EVENT;
+        if (entity_id == EVENT_BATCH_ID) return NetworkStats::EVENT_BATCH;
+        if (entity_id == SNAPSHOT_ID) return NetworkStats::SNAPSHOT;
+        if (entity_id == ACK_ID) return NetworkStats::ACK;
+        if (entity_id == PING_ID) return NetworkStats::PING;
+        if (entity_id == PONG_ID) return NetworkStats::PONG;
+        if (entity_id == DISCONNECT_ID) return NetworkStats::DISCONNECT;
+        return NetworkStats::MESSAGE;
+    }
+
+    // what a client counts its traffic with the server under, resolved once
+    inline NetworkStats::PeerStats &serverStats() {
+        static const auto stats = networkStats().peer(NetworkStats::SERVER);
+        return *stats;
+    }
+
+    /**
+     * Every payload frame is preceded by a one byte frame with the Compression::Codec it was packed with, payloads
+     * sent RAW go out without being copied. Returns the bytes sent.
+     */
+    inline size_t sendPayload(zmq::socket_t &socket, const void *data, const size_t size, const zmq::send_flags flags) {
+        const auto packed = Compression::pack(std::string_view(static_cast<const char *>(data), size));
+        const auto codec = static_cast<uint8_t>(packed ? packed->codec : Compression::RAW);
+        socket.send(zmq::buffer(&codec, 1), zmq::send_flags::sndmore);
+        if (packed) {
+            socket.send(zmq::buffer(packed->body), flags);
+            return 1 + packed->body.size();
+        }
+        socket.send(zmq::buffer(data, size), flags);
+        return 1 + size;
+    }
+
+    // the payload of a codec frame and the frame after it, empty if it can not be decoded. Returns the bytes received
+    inline size_t receivePayload(zmq::socket_t &socket, zmq::message_t &payload) {
+        zmq::message_t flag;
+        auto _ = socket.recv(flag, zmq::recv_flags::none);
+        auto _1 = socket.recv(payload, zmq::recv_flags::none);
+        const size_t received = flag.size() + payload.size();
+        const auto codec = flag.empty() ? Compression::RAW : *static_cast<const uint8_t *>(flag.data());
+        if (codec == Compression::RAW) return received;
+        try {
+            auto unpacked = Compression::unpack(static_cast<Compression::Codec>(codec), payload.to_string_view());
+            payload.rebuild(unpacked.data(), unpacked.size());
+        } catch (std::exception &e) {
+            std::cerr << "Error decompressing payload: " << e.what() << std::endl;
+            payload.rebuild(0);
+        }
+        return received;
+    }
+
+    template<typename... Types>
+    size_t sendPayload(zmq::socket_t &socket, const std::variant<Types...> &message) {
+        return std::visit([&](const auto &payload) {
+            return sendPayload(socket, payload.data(), payload.size() * sizeof(payload[0]), zmq::send_flags::none);
+        }, message);
+    }
 
     inline void sendMessageClient(zmq::socket_t &socket, const std::string &entity_id,
                                   const std::variant<std::vector<float>, std::string> &message
     ) {
         socket.send(zmq::buffer(entity_id), zmq::send_flags::sndmore);
-        if (std::holds_alternative<std::string>(message)) {
-            const auto str = std::get<std::string>(message);
-            socket.send(zmq::buffer(str), zmq::send_flags::none);
-        } else {
-            auto vec = std::get<std::vector<float> >(message);
-            socket.send(zmq::buffer(vec), zmq::send_flags::none);
-        }
+        const auto bytes = sendPayload(socket, message);
+        NetworkStats::sent(serverStats(), typeOf(entity_id), entity_id.size() + bytes);
     }
 
     inline void receiveMessageClient(zmq::socket_t &socket, zmq::message_t &message, std::string &entity_id
     ) {
         zmq::message_t eID;
-        zmq::message_t data;
 
         auto rcv_res_1 = socket.recv(eID, zmq::recv_flags::none);
-        auto rcv_res_2 = socket.recv(data, zmq::recv_flags::none);
+        const auto bytes = receivePayload(socket, message);
 
         entity_id = eID.to_string();
-        message.copy(data);
+        NetworkStats::received(serverStats(), typeOf(entity_id), eID.size() + bytes);
     }
 
     inline void sendMessageServer(zmq::socket_t &socket, const std::string& client_id, const std::string &entity_id,
                                   const std::variant<std::vector<char>, std::vector<float>> &message) {
         socket.send(zmq::buffer(client_id + "R"), zmq::send_flags::sndmore);
         socket.send(zmq::buffer(entity_id), zmq::send_flags::sndmore);
-        if (std::holds_alternative<std::vector<float> >(message)) {
-            auto str = std::get<std::vector<float> >(message);
-            socket.send(zmq::buffer(str), zmq::send_flags::none);
-        } else {
-            auto vec = std::get<std::vector<char> >(message);
-            socket.send(zmq::buffer(vec), zmq::send_flags::none);
-        }
+        const auto bytes = sendPayload(socket, message);
+        networkStats().sent(client_id, typeOf(entity_id), entity_id.size() + bytes);
     }
 
     inline void sendMessageServer(zmq::socket_t &socket, const std::string& client_id, const std::string &entity_id,
                                   const std::variant<std::vector<float>, std::string> &message) {
         socket.send(zmq::buffer(client_id + "R"), zmq::send_flags::sndmore);
         socket.send(zmq::buffer(entity_id), zmq::send_flags::sndmore);
-        if (std::holds_alternative<std::string>(message)) {
-            const auto str = std::get<std::string>(message);
-            socket.send(zmq::buffer(str), zmq::send_flags::none);
-        } else {
-            auto vec = std::get<std::vector<float> >(message);
-            socket.send(zmq::buffer(vec), zmq::send_flags::none);
+        const auto bytes = sendPayload(socket, message);
+        networkStats().sent(client_id, typeOf(entity_id), entity_id.size() + bytes);
+    }
+
+    // where sendShared sends to: the frame routing to the reply socket of a client and the stats of the client
+    struct Route {
+        zmq::message_t frame;
+        std::shared_ptr<NetworkStats::PeerStats> stats;
+    };
+
+    // build it once per client and reuse it with sendShared
+    inline Route routeTo(const std::string &client_id) {
+        return Route{zmq::message_t(client_id + "R"), networkStats().peer(client_id)};
+    }
+
+    // hands the string to zmq without copying it, it is freed when zmq is done sending it
+    inline zmq::message_t takeMessage(std::string &&data) {
+        auto *owned = new std::string(std::move(data));
+        return {
+            owned->data(), owned->size(), [](void *, void *hint) { delete static_cast<std::string *>(hint); }, owned
+        };
+    }
+
+    // a payload packed once for sendShared, with the codec frame that goes in front of it
+    struct Payload {
+        zmq::message_t codec;
+        zmq::message_t data;
+
+        [[nodiscard]] bool empty() const {
+            return data.empty();
+        }
+
+        // another reference to the same frames, to hand the payload to something that outlives this one
+        Payload share() {
+            Payload shared;
+            shared.codec.copy(codec);
+            shared.data.copy(data);
+            return shared;
+        }
+    };
+
+    inline Payload makePayload(std::string &&data) {
+        if (data.empty()) return {};
+        auto packed = Compression::pack(data);
+        const auto codec = static_cast<uint8_t>(packed ? packed->codec : Compression::RAW);
+        return Payload{zmq::message_t(&codec, 1), takeMessage(packed ? std::move(packed->body) : std::move(data))};
+    }
+
+    /**
+     * Sends the frames to a client without copying their contents. zmq_msg_copy only adds a reference to the buffer of
+     * a message (anything over 33 bytes, shorter ones are copied inline), so the same frames can be sent to any
+     * number of clients and the cost per client does not depend on their size. Empty parts are left out.
+     * A droppable message is dropped instead of waiting when the socket is at its high water mark, false if it was.
+     */
+    inline bool sendShared(zmq::socket_t &socket, Route &route, zmq::message_t &entity_id,
+                           std::initializer_list<Payload *> parts, const bool droppable = false) {
+        const Payload *last = nullptr;
+        for (const auto *part: parts) {
+            if (!part->empty()) last = part;
         }
+        if (last == nullptr) return true;
+        zmq::message_t frame;
+        frame.copy(route.frame);
+        // zmq checks the high water mark on the first frame only, the rest of an accepted message always goes out
+        if (!socket.send(frame, droppable ? zmq::send_flags::sndmore | zmq::send_flags::dontwait
+                                          : zmq::send_flags::sndmore)) {
+            NetworkStats::dropped(*route.stats);
+            return false;
+        }
+        frame.copy(entity_id);
+        socket.send(frame, zmq::send_flags::sndmore);
+        size_t bytes = entity_id.size();
+        for (auto *part: parts) {
+            if (part->empty()) continue;
+            frame.copy(part->codec);
+            socket.send(frame, zmq::send_flags::sndmore);
+            frame.copy(part->data);
+            socket.send(frame, part == last ? zmq::send_flags::none : zmq::send_flags::sndmore);
+            bytes += part->codec.size() + part->data.size();
+        }
+        NetworkStats::sent(*route.stats, typeOf(entity_id.to_string_view()), bytes);
+        return true;
+    }
+
+    // appends the remaining payloads of a multipart message from the server that was read up to its first payload
+    inline void receiveRemainingParts(zmq::socket_t &socket, std::vector<zmq::message_t> &parts) {
+        size_t bytes = 0;
+        while (socket.get(zmq::sockopt::rcvmore)) {
+            zmq::message_t part;
+            bytes += receivePayload(socket, part);
+            parts.push_back(std::move(part));
+        }
+        NetworkStats::received(serverStats(), NetworkStats::SNAPSHOT, bytes, 0);
     }
 
     inline void receiveMessageServer(zmq::socket_t &socket, zmq::message_t &identify, zmq::message_t &entity_id,
                                        zmq::message_t &entity_data) {
         auto _ = socket.recv(identify, zmq::recv_flags::none);
         auto _1 =socket.recv(entity_id, zmq::recv_flags::none);
-        auto _2 = socket.recv(entity_data, zmq::recv_flags::none);
+        const auto bytes = receivePayload(socket, entity_data);
 
+        const auto type = typeOf(entity_id.to_string_view());
+        auto client = identify.to_string_view();
+        // acks and pings come from the reply socket, counted for the client it belongs to
+        if (type == NetworkStats::ACK || type == NetworkStats::PING) client.remove_suffix(1);
+        networkStats().received(client, type, entity_id.size() + bytes);
+    }
+
+    inline void appendBatchedEvent(std::string &batch, const std::string_view event) {
+        ByteWriter(batch).string(event);
+    }
+
+    // calls onEvent(event) for the events of an EVENT_BATCH_ID message, throws std::runtime_error if it is malformed
+    template<typename OnEvent>
+    void forEachBatchedEvent(const zmq::message_t &batch, OnEvent onEvent) {
+        ByteReader reader(batch.data(), batch.size());
+        while (!reader.done()) {
+            const auto size = reader.varint();
+            const auto event = reader.rest().substr(0, size);
+            reader.skip(size);
+            onEvent(event);
+        }
     }
 
     inline void sendEventClient(zmq::socket_t &socket, const std::shared_ptr<Event> &event) {
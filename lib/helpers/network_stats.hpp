@@ -0,0 +1,318 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "compression.hpp"
+#include "../EMS/event_stats.hpp"
+
+/**
+ * Traffic counters of everything NetworkHelper sends and receives: messages and bytes on the wire (after compression)
+ * per peer and message type, sends dropped because the socket was full, time spent encoding and decoding, the backlog
+ * the server had to send per tick and the round trip time to each peer measured with pings. The peer of a client is
+ * "server", the server counts per client identity. Always on. Counting for a peer by name looks it up in a map under a
+ * shared lock, the hot paths resolve the PeerStats of a peer once with peer() and keep it, after that counting is a
+ * few relaxed atomic adds without any lookup or lock. A peer that is forgotten stops being listed, what it counted,
+ * also through a PeerStats kept since, stays in the totals.
+ */
+class NetworkStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // what a message is counted as, see NetworkHelper::typeOf
+    enum MessageType : uint8_t {
+        MESSAGE,
+        EVENT,
+        EVENT_BATCH,
+        SNAPSHOT,
+        ACK,
+        PING,
+        PONG,
+        DISCONNECT,
+        MESSAGE_TYPES
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> messagesIn{0};
+        std::atomic<uint64_t> messagesOut{0};
+        std::atomic<uint64_t> bytesIn{0};
+        std::atomic<uint64_t> bytesOut{0};
+    };
+
+    // everything counted for one peer
+    struct PeerStats {
+        std::array<Counters, MESSAGE_TYPES> types;
+        std::atomic<uint64_t> dropped{0};
+        // smoothed like TCP's SRTT, -1 until the first ping came back
+        std::atomic<int64_t> rttMicros{-1};
+        // ticks between the snapshots the server sends the client, more than 1 while it is behind
+        std::atomic<int> interval{1};
+    };
+
+    // totals over all peers, for rates between two snapshots
+    struct Totals {
+        uint64_t messagesIn = 0;
+        uint64_t messagesOut = 0;
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        uint64_t dropped = 0;
+    };
+
+private:
+    static constexpr std::array<const char *, MESSAGE_TYPES> TYPE_NAMES{
+        "message", "event", "event batch", "snapshot", "ack", "ping", "pong", "disconnect"
+    };
+
+    mutable std::shared_mutex mutex;
+    // shared so a peer being forgotten is not freed while another thread counts for it
+    std::map<std::string, std::shared_ptr<PeerStats>, std::less<> > peers;
+    // forgotten peers someone still counts for, summed into forgotten once they are the last to hold them
+    std::vector<std::shared_ptr<PeerStats> > retired;
+    std::map<std::string, std::unique_ptr<LatencyHistogram> > encodeTimes;
+    std::map<std::string, std::unique_ptr<LatencyHistogram> > decodeTimes;
+    LatencyHistogram rtt;
+    std::atomic<uint64_t> backlog{0};
+    std::atomic<uint64_t> maxBacklog{0};
+    // what the forgotten peers added to the totals
+    Totals forgotten;
+
+    LatencyHistogram &histogram(std::map<std::string, std::unique_ptr<LatencyHistogram> > &histograms,
+                                const std::string &name) {
+        {
+            std::shared_lock lock(mutex);
+            if (const auto it = histograms.find(name); it != histograms.end()) return *it->second;
+        }
+        std::unique_lock lock(mutex);
+        auto &histogram = histograms[name];
+        if (!histogram) histogram = std::make_unique<LatencyHistogram>();
+        return *histogram;
+    }
+
+    static void add(Totals &totals, const PeerStats &stats) {
+        totals.dropped += stats.dropped;
+        for (const auto &counters: stats.types) {
+            totals.messagesIn += counters.messagesIn;
+            totals.messagesOut += counters.messagesOut;
+            totals.bytesIn += counters.bytesIn;
+            totals.bytesOut += counters.bytesOut;
+        }
+    }
+
+    static bool counted(const Counters &counters) {
+        return counters.messagesIn != 0 || counters.messagesOut != 0;
+    }
+
+    static std::string formatMillis(const uint64_t nanos) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << static_cast<double>(nanos) / 1e6 << "ms";
+        return out.str();
+    }
+
+public:
+    static constexpr auto SERVER = "server";
+
+    // the counters of the peer, created on first use, to keep and count for without looking the peer up every time
+    std::shared_ptr<PeerStats> peer(const std::string_view name) {
+        {
+            std::shared_lock lock(mutex);
+            if (const auto it = peers.find(name); it != peers.end()) return it->second;
+        }
+        std::unique_lock lock(mutex);
+        auto it = peers.find(name);
+        if (it == peers.end()) it = peers.emplace(std::string(name), std::make_shared<PeerStats>()).first;
+        return it->second;
+    }
+
+    static void sent(PeerStats &peerStats, const MessageType type, const size_t bytes) {
+        auto &stats = peerStats.types[type];
+        stats.messagesOut.fetch_add(1, std::memory_order_relaxed);
+        stats.bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // messages is 0 for the further parts of a message that was already counted
+    static void received(PeerStats &peerStats, const MessageType type, const size_t bytes, const int messages = 1) {
+        auto &stats = peerStats.types[type];
+        stats.messagesIn.fetch_add(messages, std::memory_order_relaxed);
+        stats.bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    static void dropped(PeerStats &peerStats) {
+        peerStats.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sent(const std::string_view peerName, const MessageType type, const size_t bytes) {
+        sent(*peer(peerName), type, bytes);
+    }
+
+    void received(const std::string_view peerName, const MessageType type, const size_t bytes,
+                  const int messages = 1) {
+        received(*peer(peerName), type, bytes, messages);
+    }
+
+    void dropped(const std::string_view peerName) {
+        dropped(*peer(peerName));
+    }
+
+    void encoded(const std::string &what, const Clock::time_point start) {
+        histogram(encodeTimes, what).record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count());
+    }
+
+    void decoded(const std::string &what, const Clock::time_point start) {
+        histogram(decodeTimes, what).record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count());
+    }
+
+    void rttMeasured(const std::string &peerName, const int64_t micros) {
+        if (micros < 0) return;
+        rtt.record(static_cast<uint64_t>(micros) * 1000);
+        const auto stats = peer(peerName);
+        auto &smoothed = stats->rttMicros;
+        const auto previous = smoothed.load(std::memory_order_relaxed);
+        smoothed.store(previous < 0 ? micros : previous + (micros - previous) / 8, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] int64_t rttOf(const std::string &peerName) {
+        return peer(peerName)->rttMicros.load(std::memory_order_relaxed);
+    }
+
+    void intervalChanged(const std::string &peerName, const int ticks) {
+        peer(peerName)->interval.store(ticks, std::memory_order_relaxed);
+    }
+
+    // what was waiting to be sent when a tick went out
+    void backlogMeasured(const uint64_t size) {
+        backlog.store(size, std::memory_order_relaxed);
+        auto max = maxBacklog.load(std::memory_order_relaxed);
+        while (size > max && !maxBacklog.compare_exchange_weak(max, size, std::memory_order_relaxed)) {
+        }
+    }
+
+    void forget(const std::string &peerName) {
+        std::unique_lock lock(mutex);
+        const auto it = peers.find(peerName);
+        if (it == peers.end()) return;
+        retired.push_back(std::move(it->second));
+        peers.erase(it);
+        std::erase_if(retired, [this](const std::shared_ptr<PeerStats> &stats) {
+            if (stats.use_count() > 1) return false;
+            add(forgotten, *stats);
+            return true;
+        });
+    }
+
+    [[nodiscard]] Totals totals() const {
+        std::shared_lock lock(mutex);
+        Totals totals = forgotten;
+        for (const auto &[name, stats]: peers) {
+            add(totals, *stats);
+        }
+        for (const auto &stats: retired) {
+            add(totals, *stats);
+        }
+        return totals;
+    }
+
+    // one line with the rates since previous, for a periodic log
+    [[nodiscard]] std::string summary(const Totals &current, const Totals &previous, const double seconds) const {
+        const auto rate = [seconds](const uint64_t now, const uint64_t before) {
+            return static_cast<double>(now - before) / std::max(seconds, 1e-3);
+        };
+        size_t peerCount; {
+            std::shared_lock lock(mutex);
+            peerCount = peers.size();
+        }
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << "peers " << peerCount
+                << " | in " << rate(current.bytesIn, previous.bytesIn) / 1024 << " KB/s "
+                << rate(current.messagesIn, previous.messagesIn) << " msg/s"
+                << " | out " << rate(current.bytesOut, previous.bytesOut) / 1024 << " KB/s "
+                << rate(current.messagesOut, previous.messagesOut) << " msg/s"
+                << " | dropped " << current.dropped - previous.dropped
+                << " | backlog " << backlog << " (max " << maxBacklog << ")"
+                << " | rtt p50 " << formatMillis(rtt.percentile(0.5)) << " p99 " << formatMillis(rtt.percentile(0.99));
+        return out.str();
+    }
+
+    [[nodiscard]] nlohmann::json toJson() const {
+        std::shared_lock lock(mutex);
+        nlohmann::json json;
+        for (const auto &[name, stats]: peers) {
+            auto &peer = json["peers"][name];
+            peer["dropped"] = stats->dropped.load();
+            peer["rttMicros"] = stats->rttMicros.load();
+            peer["interval"] = stats->interval.load();
+            for (size_t type = 0; type < MESSAGE_TYPES; type++) {
+                const auto &counters = stats->types[type];
+                if (!counted(counters)) continue;
+                peer["types"][TYPE_NAMES[type]] = {
+                    {"messagesIn", counters.messagesIn.load()}, {"messagesOut", counters.messagesOut.load()},
+                    {"bytesIn", counters.bytesIn.load()}, {"bytesOut", counters.bytesOut.load()}
+                };
+            }
+        }
+        for (const auto &[label, histograms]: {std::pair{"encodeNanos", &encodeTimes}, {"decodeNanos", &decodeTimes}}) {
+            for (const auto &[what, histogram]: *histograms) {
+                json[label][what] = {
+                    {"count", histogram->total()}, {"p50", histogram->percentile(0.5)},
+                    {"p99", histogram->percentile(0.99)}
+                };
+            }
+        }
+        json["rttNanos"] = {{"p50", rtt.percentile(0.5)}, {"p99", rtt.percentile(0.99)}};
+        json["backlog"] = {{"last", backlog.load()}, {"max", maxBacklog.load()}};
+        const auto &compression = Compression::stats();
+        json["compression"] = {
+            {"bytesIn", compression.bytesIn.load()}, {"bytesOut", compression.bytesOut.load()},
+            {"packNanos", compression.compressNanos.load()}, {"unpackNanos", compression.decompressNanos.load()}
+        };
+        return json;
+    }
+
+    void dump(std::ostream &out) const {
+        std::shared_lock lock(mutex);
+        out << "Network stats" << std::endl;
+        out << std::left << std::setw(28) << "peer / type" << std::right << std::setw(10) << "msg in"
+                << std::setw(12) << "bytes in" << std::setw(10) << "msg out" << std::setw(12) << "bytes out"
+                << std::setw(10) << "dropped" << std::setw(12) << "rtt" << std::endl;
+        for (const auto &[name, stats]: peers) {
+            const auto rttMicros = stats->rttMicros.load();
+            out << std::left << std::setw(28) << name << std::right << std::setw(54) << stats->dropped
+                    << std::setw(12) << (rttMicros < 0 ? "-" : formatMillis(rttMicros * 1000)) << std::endl;
+            for (size_t type = 0; type < MESSAGE_TYPES; type++) {
+                const auto &counters = stats->types[type];
+                if (!counted(counters)) continue;
+                out << std::left << std::setw(28) << (std::string("  ") + TYPE_NAMES[type]) << std::right
+                        << std::setw(10) << counters.messagesIn << std::setw(12) << counters.bytesIn << std::setw(10)
+                        << counters.messagesOut << std::setw(12) << counters.bytesOut << std::endl;
+            }
+        }
+        for (const auto &[label, histograms]: {std::pair{"encode", &encodeTimes}, {"decode", &decodeTimes}}) {
+            for (const auto &[what, histogram]: *histograms) {
+                out << std::left << std::setw(28) << (std::string(label) + " " + what) << std::right
+                        << std::setw(10) << histogram->total() << "  p50 " << formatMillis(histogram->percentile(0.5))
+                        << "  p99 " << formatMillis(histogram->percentile(0.99)) << std::endl;
+            }
+        }
+        out << "backlog " << backlog << " (max " << maxBacklog << "), compression " << Compression::summary()
+                << std::endl;
+    }
+};
+
+inline NetworkStats &networkStats() {
+    static NetworkStats stats;
+    return stats;
+}
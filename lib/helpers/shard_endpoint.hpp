@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+/**
+ * Where the front end shards of a server listen. Shard 0 is at the base endpoint, shard i of a tcp endpoint at the
+ * port of the base plus i and of any other transport at the base with "-i" appended. A client picks its shard by a
+ * hash of its identity, so its reply socket ends up on the same shard as the socket it sends with.
+ */
+namespace ShardEndpoint {
+    inline std::string of(const std::string &base, const int shard) {
+        if (shard == 0) return base;
+        if (base.starts_with("tcp://")) {
+            const auto colon = base.rfind(':');
+            return base.substr(0, colon + 1) + std::to_string(std::stoi(base.substr(colon + 1)) + shard);
+        }
+        return base + "-" + std::to_string(shard);
+    }
+
+    // FNV-1a, unlike std::hash the same in every build
+    inline int shardOf(const std::string &identity, const int shards) {
+        uint32_t hash = 2166136261u;
+        for (const char c: identity) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return static_cast<int>(hash % static_cast<uint32_t>(std::max(shards, 1)));
+    }
+
+    inline std::string forClient(const std::string &base, const std::string &identity, const int shards) {
+        return of(base, shardOf(identity, shards));
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <zmq.hpp>
+
+#include "network_stats.hpp"
+
+/**
+ * Makes the NetworkStats of a running process readable from outside:
+ *   SHADE_STATS_INTERVAL  seconds between summary log lines, 0 prints none (default 0)
+ *   SHADE_STATS_ENDPOINT  zmq endpoint, e.g. tcp://127.0.0.1:5580, where a REQ socket gets the full stats as JSON for
+ *                         any request (not bound by default)
+ */
+namespace StatsReporter {
+    /**
+     * Starts the reporter thread if either is set. It runs until the process exits, name prefixes its log lines.
+     */
+    inline void startFromEnvironment(const std::string &name) {
+        const char *intervalValue = std::getenv("SHADE_STATS_INTERVAL");
+        const char *endpointValue = std::getenv("SHADE_STATS_ENDPOINT");
+        const int interval = intervalValue != nullptr ? std::atoi(intervalValue) : 0;
+        const std::string endpoint = endpointValue != nullptr ? endpointValue : "";
+        if (interval <= 0 && endpoint.empty()) return;
+
+        std::thread([name, interval, endpoint] {
+            using Clock = std::chrono::steady_clock;
+            zmq::context_t context(1);
+            zmq::socket_t socket(context, ZMQ_REP);
+            if (!endpoint.empty()) {
+                socket.bind(endpoint);
+                std::cout << "[" << name << "] stats on " << endpoint << std::endl;
+            }
+            const auto period = std::chrono::seconds(interval > 0 ? interval : 3600);
+            auto previous = networkStats().totals();
+            auto lastLine = Clock::now();
+            while (true) {
+                const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    lastLine + period - Clock::now());
+                zmq::pollitem_t items[] = {{static_cast<void *>(socket), 0, ZMQ_POLLIN, 0}};
+                zmq::poll(items, endpoint.empty() ? 0 : 1, std::max(wait, std::chrono::milliseconds(0)));
+                if (items[0].revents & ZMQ_POLLIN) {
+                    zmq::message_t request;
+                    do {
+                        auto _ = socket.recv(request, zmq::recv_flags::none);
+                    } while (request.more());
+                    socket.send(zmq::buffer(networkStats().toJson().dump()), zmq::send_flags::none);
+                }
+                if (interval > 0 && Clock::now() >= lastLine + period) {
+                    const auto now = Clock::now();
+                    const auto current = networkStats().totals();
+                    const double seconds = std::chrono::duration<double>(now - lastLine).count();
+                    std::cout << "[" << name << "] " << networkStats().summary(current, previous, seconds) << std::endl;
+                    previous = current;
+                    lastLine = now;
+                }
+            }
+        }).detach();
+    }
+}
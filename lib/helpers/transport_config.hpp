@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Where the server listens and its clients connect, read from the environment:
+ *   SHADE_TRANSPORT        tcp (default), ipc for processes on the same host or inproc for a server and its clients in
+ *                          a single process sharing one zmq context
+ *   SHADE_SERVER_ENDPOINT  the endpoint clients connect to instead of the default of the transport, e.g.
+ *                          tcp://10.0.0.2:6000 or ipc:///run/shade/server, a tcp server binds its port on every
+ *                          interface
+ * With shards every shard has an endpoint of its own derived from these, see ShardEndpoint.
+ */
+struct TransportConfig {
+    std::string bind = "tcp://*:5570";
+    std::string connect = "tcp://localhost:5570";
+
+    // what the server binds to be reached at the endpoint
+    static std::string bindOf(const std::string &endpoint) {
+        if (!endpoint.starts_with("tcp://")) return endpoint;
+        return "tcp://*" + endpoint.substr(endpoint.rfind(':'));
+    }
+
+    static TransportConfig forEndpoint(const std::string &endpoint) {
+        return TransportConfig{bindOf(endpoint), endpoint};
+    }
+
+    static TransportConfig fromEnvironment() {
+        const char *transport = std::getenv("SHADE_TRANSPORT");
+        const char *endpoint = std::getenv("SHADE_SERVER_ENDPOINT");
+        if (endpoint != nullptr) return forEndpoint(endpoint);
+        const std::string name = transport != nullptr ? transport : "tcp";
+        if (name == "ipc") return forEndpoint("ipc:///tmp/shade-engine");
+        if (name == "inproc") return forEndpoint("inproc://shade-engine");
+        if (name != "tcp") std::cerr << "Unknown SHADE_TRANSPORT " << name << ", using tcp" << std::endl;
+        return TransportConfig{};
+    }
+
+    // only reachable from the process that binds it
+    [[nodiscard]] bool inProcess() const {
+        return connect.starts_with("inproc://");
+    }
+};
@@ -227,6 +227,15 @@ struct VerticalBoost {
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(VerticalBoost, velocity)
 
+// an entity this client moves itself and the server confirms, sequence counts the frames it was simulated for
+struct Predicted {
+    uint32_t sequence = 0;
+    // moved without simulating the way there, a respawn, the server takes the next state as is
+    bool teleported = false;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Predicted, sequence, teleported)
+
 using ALL_COMPONENTS = std::variant<Transform, Color, CKinematic, Camera, Gravity, KeyboardMovement, Server, Receiver,
     MovingPlatform, ServerEntity, ClientEntity, Destroy, Collision, Jump, Respawnable, RigidBody, Dash, Stomp,
-    VerticalBoost>;
+    VerticalBoost, Predicted>;
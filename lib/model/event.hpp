@@ -8,6 +8,7 @@
 #include <nlohmann/json.hpp>
 #include "../ECS/types.hpp"
 #include "../model/components.hpp"
+#include "../model/data_model.hpp"
 
 // all the events in the game engine will inherit from this class
 enum EventType {
@@ -27,7 +28,12 @@ enum EventType {
     StartReplaying,
     StopReplaying,
     EntityCreated,
-    EntityDestroyed
+    EntityDestroyed,
+    TransformReplicated,
+    InterestChanged,
+    InputAcknowledged,
+    // the server registered the client anew after dropping it, it forgot the players the client created
+    Rejoined
 };
 
 inline std::string eventTypeToString(EventType type) {
@@ -64,6 +70,14 @@ inline std::string eventTypeToString(EventType type) {
             return "EntityCreated";
         case EntityDestroyed:
             return "EntityDestroyed";
+        case TransformReplicated:
+            return "TransformReplicated";
+        case InterestChanged:
+            return "InterestChanged";
+        case InputAcknowledged:
+            return "InputAcknowledged";
+        case Rejoined:
+            return "Rejoined";
         default: return "Unknown";
     }
 }
@@ -79,7 +93,7 @@ struct EntityDeathData {
     Transform respawnPosition;
 };
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(EntityDeathData, respawnPosition);
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(EntityDeathData, entity, respawnPosition);
 
 struct EntityCollidedData {
     Entity entityA;
@@ -102,19 +116,51 @@ struct EntityInputData {
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(EntityInputData, entity, key)
 
+// a client's player, with the components the other clients create it from (see creationComponents)
 struct MainCharCreatedData {
     Entity entity;
-    std::string message;
+    std::string entity_key;
+    std::vector<SERIALIZABLE_COMPONENTS> components;
 };
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(MainCharCreatedData, entity, message)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(MainCharCreatedData, entity, entity_key, components)
 
+// the local entity id means nothing to the receiver, the key identifies the entity
 struct PositionChangedData {
-    Entity entity;
-    std::string message;
+    std::string entity_key;
+    Transform transform;
+    uint32_t sequence = 0; // the Predicted frame of the entity the update is from, 0 if it is not predicted
+    bool teleported = false; // the entity did not move there, see Predicted
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PositionChangedData, entity_key, transform, sequence, teleported)
+
+// a remote entity's transform decoded from the server's delta stream
+struct TransformReplicatedData {
+    std::string entity_key;
+    Transform transform;
+    int64_t time = 0; // when the server sent it on the local clock in milliseconds, see ServerClock
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(TransformReplicatedData, entity_key, transform, time)
+
+// a remote entity entered or left the area the server sends this client updates for
+struct InterestChangedData {
+    std::string entity_key;
+    bool visible;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(InterestChangedData, entity_key, visible)
+
+// the server processed the updates of a predicted entity up to sequence, corrected if it did not accept the state
+struct InputAcknowledgedData {
+    std::string entity_key;
+    uint32_t sequence;
+    bool corrected;
+    Transform transform;
 };
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PositionChangedData, entity, message)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(InputAcknowledgedData, entity_key, sequence, corrected, transform)
 
 struct DashData {
     Entity entity;
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * The clients the server sends snapshots to. A client is registered by the first message it sends and stays until it
+ * says goodbye or nothing was heard from it for the timeout, its pings every second keep an idle client alive. Also
+ * remembers the entities every client sent, they are deleted everywhere once it is gone. Shared by all workers, a
+ * message from a known client only takes the shared lock.
+ */
+class ClientRegistry {
+    using Clock = std::chrono::steady_clock;
+
+    struct Client {
+        std::atomic<Clock::rep> lastSeen;
+        // guarded by the exclusive lock of the registry
+        std::unordered_set<std::string> entities;
+    };
+
+    const Clock::duration timeout;
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<Client> > clients;
+    std::atomic<Clock::rep> nextSweep;
+
+    static Clock::rep now() {
+        return Clock::now().time_since_epoch().count();
+    }
+
+public:
+    // a client that left, with the keys of the entities it had sent
+    struct Departed {
+        std::string client;
+        std::vector<std::string> entities;
+    };
+
+    // timeoutSeconds of 0 or less keeps silent clients forever, they only leave by saying goodbye
+    explicit ClientRegistry(const double timeoutSeconds)
+        : timeout(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeoutSeconds))),
+          nextSweep(now()) {
+    }
+
+    // the client sent a message, registers it if it is new and returns whether it was
+    bool touch(const std::string &client) {
+        {
+            std::shared_lock lock(mutex);
+            if (const auto it = clients.find(client); it != clients.end()) {
+                it->second->lastSeen.store(now(), std::memory_order_relaxed);
+                return false;
+            }
+        }
+        std::unique_lock lock(mutex);
+        auto &entry = clients[client];
+        if (entry) {
+            entry->lastSeen.store(now(), std::memory_order_relaxed);
+            return false;
+        }
+        entry = std::make_unique<Client>();
+        entry->lastSeen.store(now(), std::memory_order_relaxed);
+        return true;
+    }
+
+    // a heartbeat, unlike touch it does not register a client the server does not know (anymore)
+    void refresh(const std::string &client) {
+        std::shared_lock lock(mutex);
+        if (const auto it = clients.find(client); it != clients.end()) {
+            it->second->lastSeen.store(now(), std::memory_order_relaxed);
+        }
+    }
+
+    // the client sent updates of the entity, it is deleted when the client leaves
+    void own(const std::string &client, const std::string &key) {
+        {
+            std::shared_lock lock(mutex);
+            const auto it = clients.find(client);
+            if (it == clients.end() || it->second->entities.contains(key)) return;
+        }
+        std::unique_lock lock(mutex);
+        if (const auto it = clients.find(client); it != clients.end()) {
+            it->second->entities.insert(key);
+        }
+    }
+
+    // unregisters the client, nothing when it was not registered
+    std::optional<Departed> remove(const std::string &client) {
+        std::unique_lock lock(mutex);
+        const auto it = clients.find(client);
+        if (it == clients.end()) return std::nullopt;
+        Departed departed{client, {it->second->entities.begin(), it->second->entities.end()}};
+        clients.erase(it);
+        return departed;
+    }
+
+    /**
+     * Unregisters and returns the clients that were silent for longer than the timeout. Looks at most once a second,
+     * whichever worker calls it first does the sweep and the others return right away.
+     */
+    std::vector<Departed> removeExpired() {
+        std::vector<Departed> departed;
+        if (timeout <= Clock::duration::zero()) return departed;
+        const auto current = now();
+        auto due = nextSweep.load(std::memory_order_relaxed);
+        if (current < due) return departed;
+        const auto next = current + std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)).count();
+        if (!nextSweep.compare_exchange_strong(due, next, std::memory_order_relaxed)) return departed;
+
+        const auto oldest = current - timeout.count();
+        std::unique_lock lock(mutex);
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (it->second->lastSeen.load(std::memory_order_relaxed) >= oldest) {
+                ++it;
+                continue;
+            }
+            departed.push_back(Departed{it->first, {it->second->entities.begin(), it->second->entities.end()}});
+            it = clients.erase(it);
+        }
+        return departed;
+    }
+
+    [[nodiscard]] std::vector<std::string> recipients() const {
+        std::shared_lock lock(mutex);
+        std::vector<std::string> names;
+        names.reserve(clients.size());
+        for (const auto &[name, client]: clients) {
+            names.push_back(name);
+        }
+        return names;
+    }
+};
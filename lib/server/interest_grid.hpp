@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../model/components.hpp"
+
+/**
+ * Spatial hash of the replicated entities used to decide which of them a client is interested in. A client's interest
+ * is a circle of the configured radius around its anchor, the player it announced with MainCharCreated. The cells are
+ * as large as the radius so a query only looks at the 3 x 3 cells around the anchor. Not thread safe, only the
+ * SnapshotBroadcaster uses it while flushing a tick.
+ */
+class InterestGrid {
+    struct Entry {
+        std::string owner;
+        Transform transform;
+        int64_t cell;
+    };
+
+    const float radius;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<int64_t, std::unordered_set<std::string> > cells;
+    std::unordered_map<std::string, std::string> anchors; // client -> key of its player
+    std::unordered_map<std::string, std::unordered_set<std::string> > visible; // client -> keys it currently gets
+
+    [[nodiscard]] int32_t cellCoordinate(const float value) const {
+        return static_cast<int32_t>(std::floor(value / radius));
+    }
+
+    static int64_t cellOf(const int32_t x, const int32_t y) {
+        return static_cast<int64_t>(x) << 32 | static_cast<uint32_t>(y);
+    }
+
+public:
+    // a radius of 0 or less disables the filtering
+    explicit InterestGrid(const float radius) : radius(radius) {
+    }
+
+    [[nodiscard]] bool enabled() const {
+        return radius > 0;
+    }
+
+    // the latest transform of an entity, owner is the client that sends its updates
+    void move(const std::string &key, const std::string &owner, const Transform &transform) {
+        const auto cell = cellOf(cellCoordinate(transform.x), cellCoordinate(transform.y));
+        const auto [it, inserted] = entries.try_emplace(key, Entry{owner, transform, cell});
+        if (!inserted) {
+            if (it->second.cell != cell) {
+                cells[it->second.cell].erase(key);
+                cells[cell].insert(key);
+            }
+            it->second = Entry{owner, transform, cell};
+        } else {
+            cells[cell].insert(key);
+        }
+    }
+
+    [[nodiscard]] const Transform *transformOf(const std::string &key) const {
+        const auto it = entries.find(key);
+        return it == entries.end() ? nullptr : &it->second.transform;
+    }
+
+    void setAnchor(const std::string &client, const std::string &key) {
+        anchors[client] = key;
+    }
+
+    // false while the client has no anchor with a known position, it then gets every entity
+    [[nodiscard]] bool filters(const std::string &client) const {
+        if (!enabled()) return false;
+        const auto anchor = anchors.find(client);
+        return anchor != anchors.end() && entries.contains(anchor->second);
+    }
+
+    /**
+     * Recomputes what the client is interested in. Returns the keys that entered and left its interest since the
+     * last call, the client's own entities are never part of it. Only valid when filters(client).
+     */
+    void update(const std::string &client, std::vector<std::string> &entered, std::vector<std::string> &left) {
+        const auto &center = entries.at(anchors.at(client)).transform;
+        const auto cx = cellCoordinate(center.x);
+        const auto cy = cellCoordinate(center.y);
+        std::unordered_set<std::string> now;
+        for (int32_t x = cx - 1; x <= cx + 1; x++) {
+            for (int32_t y = cy - 1; y <= cy + 1; y++) {
+                const auto cell = cells.find(cellOf(x, y));
+                if (cell == cells.end()) continue;
+                for (const auto &key: cell->second) {
+                    const auto &entry = entries.at(key);
+                    if (entry.owner == client) continue;
+                    const float dx = entry.transform.x - center.x;
+                    const float dy = entry.transform.y - center.y;
+                    if (dx * dx + dy * dy <= radius * radius) now.insert(key);
+                }
+            }
+        }
+
+        auto &previous = visible[client];
+        for (const auto &key: now) {
+            if (!previous.contains(key)) entered.push_back(key);
+        }
+        for (const auto &key: previous) {
+            if (!now.contains(key)) left.push_back(key);
+        }
+        previous.swap(now);
+    }
+
+    [[nodiscard]] bool isVisible(const std::string &client, const std::string &key) const {
+        const auto it = visible.find(client);
+        return it != visible.end() && it->second.contains(key);
+    }
+
+    void forget(const std::string &client) {
+        anchors.erase(client);
+        visible.erase(client);
+    }
+
+    // an entity that was deleted, no client is told it left its interest
+    void remove(const std::string &key) {
+        const auto it = entries.find(key);
+        if (it == entries.end()) return;
+        cells[it->second.cell].erase(key);
+        entries.erase(it);
+        for (auto &[client, keys]: visible) {
+            keys.erase(key);
+        }
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "../helpers/constants.hpp"
+#include "../model/components.hpp"
+
+/**
+ * Decides the authoritative state of the entities clients predict. A client sends the state it simulated and the
+ * server either accepts it or corrects it, and the client reconciles with whatever comes back. The only rule so far is
+ * a speed limit: an entity may not move further than maxSpeed allows since its last accepted state. The time since is
+ * the longer of the client's frames in between, by the sequences of the updates, and the time between their arrival,
+ * so updates bunched up by the network are not corrected, but never more than MAX_ELAPSED, so a player that stood
+ * still for a while cannot make up for it in one jump. An entity that teleported, a respawn or the end of a replay, is
+forgotten first so its new state is accepted as is. This is where more server side rules go. Shared by all workers.
+ */
+class MovementAuthority {
+    using Clock = std::chrono::steady_clock;
+
+    struct Accepted {
+        Clock::time_point time;
+        uint32_t sequence;
+        Transform transform;
+    };
+
+    // the most movement time a single update may account for, in seconds
+    static constexpr float MAX_ELAPSED = 0.25f;
+
+    const float maxSpeed;
+    std::mutex mutex;
+    std::unordered_map<std::string, Accepted> accepted;
+
+public:
+    // maxSpeed in pixels per second, 0 accepts every state
+    explicit MovementAuthority(const float maxSpeed) : maxSpeed(maxSpeed) {
+    }
+
+    /**
+     * The state the server accepts for the entity given the state its client reported for the frame with the sequence.
+     * Sets corrected when it differs from the reported one.
+     */
+    Transform authorize(const std::string &key, const Transform &reported, const uint32_t sequence, bool &corrected) {
+        corrected = false;
+        const auto now = Clock::now();
+        std::lock_guard lock(mutex);
+        const auto [it, inserted] = accepted.try_emplace(key, Accepted{now, sequence, reported});
+        if (inserted || maxSpeed <= 0) {
+            it->second = Accepted{now, sequence, reported};
+            return reported;
+        }
+
+        auto &last = it->second;
+        const float frames = sequence > last.sequence ? static_cast<float>(sequence - last.sequence) : 0.f;
+        const float arrival = std::chrono::duration<float>(now - last.time).count();
+        const float elapsed = std::min(std::max(frames * engine_constants::FRAME_RATE, arrival), MAX_ELAPSED);
+        const float dx = reported.x - last.transform.x;
+        const float dy = reported.y - last.transform.y;
+        const float distance = std::sqrt(dx * dx + dy * dy);
+        const float allowed = maxSpeed * elapsed;
+        Transform transform = reported;
+        if (distance > allowed) {
+            transform.x = last.transform.x + dx / distance * allowed;
+            transform.y = last.transform.y + dy / distance * allowed;
+            corrected = true;
+        }
+        last = Accepted{now, sequence, transform};
+        return transform;
+    }
+
+    void forget(const std::string &key) {
+        std::lock_guard lock(mutex);
+        accepted.erase(key);
+    }
+};
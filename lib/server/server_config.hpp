@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+#include "../core/defs.hpp"
+
+/**
+ * Server settings read from the environment, so the same binary can be tuned without a rebuild:
+ *   SHADE_TICK_RATE        snapshots sent to every client per second (default 30)
+ *   SHADE_INTEREST_RADIUS  pixels around its player a client gets updates for, 0 sends everything (default one screen
+ *                          width)
+ *   SHADE_MAX_SPEED        pixels per second a predicted player may move before the server corrects it, 0 accepts
+ *                          every state (default 0)
+ *   SHADE_CLIENT_TIMEOUT   seconds without any message, pings included, after which a client is dropped and its
+ *                          entities deleted, 0 never drops one (default 5)
+ *   SHADE_SHARDS           front end shards, each with its own socket, workers and clients (default 1), the clients
+ *                          have to be started with the same value to spread over them (see ShardEndpoint)
+ *   SHADE_WORKERS          worker threads of every shard (default 5)
+ */
+struct ServerConfig {
+    int tickRate = 30;
+    float interestRadius = SCREEN_WIDTH;
+    float maxSpeed = 0;
+    double clientTimeout = 5;
+    int shards = 1;
+    int workers = 5;
+
+    static ServerConfig fromEnvironment() {
+        ServerConfig config;
+        config.tickRate = static_cast<int>(readNumber("SHADE_TICK_RATE", config.tickRate, 1));
+        config.interestRadius = static_cast<float>(readNumber("SHADE_INTEREST_RADIUS", config.interestRadius, 0));
+        config.maxSpeed = static_cast<float>(readNumber("SHADE_MAX_SPEED", config.maxSpeed, 0));
+        config.clientTimeout = readNumber("SHADE_CLIENT_TIMEOUT", config.clientTimeout, 0);
+        config.shards = static_cast<int>(readNumber("SHADE_SHARDS", config.shards, 1));
+        config.workers = static_cast<int>(readNumber("SHADE_WORKERS", config.workers, 1));
+        return config;
+    }
+
+private:
+    // the value of the variable if it is set to a number of at least minimum, otherwise fallback
+    static double readNumber(const char *name, const double fallback, const double minimum) {
+        const char *value = std::getenv(name);
+        if (value == nullptr) return fallback;
+        try {
+            const double parsed = std::stod(value);
+            return parsed >= minimum ? parsed : fallback;
+        } catch (std::exception &) {
+            return fallback;
+        }
+    }
+};
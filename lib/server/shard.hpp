@@ -0,0 +1,107 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+
+#include "client_registry.hpp"
+#include "movement_authority.hpp"
+#include "server_config.hpp"
+#include "shard_bus.hpp"
+#include "snapshot_broadcaster.hpp"
+#include "transform_replicator.hpp"
+#include "worker.hpp"
+#include "world_bootstrap.hpp"
+#include "../helpers/shard_endpoint.hpp"
+
+/**
+ * One front end of the server: a ROUTER socket the clients of the shard connect to, proxied to its own pool of
+ * workers, with its own registry of clients and replication state. What its clients send reaches the clients of the
+ * other shards over the ShardBus, the listener thread of a shard feeds what the others publish into its broadcaster
+ * as if the clients that sent it were its own. Only the world every new client is sent is shared by all shards. The
+ * inproc endpoints between its sockets are named after the endpoint of the shard, so several servers can share a
+ * context.
+ */
+class Shard {
+    zmq::context_t &context;
+    const int index;
+    const ServerConfig config;
+    const std::string base;
+    const std::string endpoint;
+    ClientRegistry clients;
+    TransformReplicator replicator;
+    SnapshotBroadcaster broadcaster;
+    MovementAuthority authority;
+    zmq::socket_t frontend;
+    zmq::socket_t backend;
+    zmq::socket_t bus;
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    std::string backendEndpoint() const {
+        return "inproc://shade-backend@" + endpoint;
+    }
+
+    // applies what the clients of the other shards sent, runs until the process exits
+    void listen() {
+        try {
+            while (true) {
+                auto record = ShardBus::receive(bus);
+                if (record.kind == ShardBus::TRANSFORM) {
+                    broadcaster.submitTransform(record.source, record.key, record.transform);
+                } else if (record.kind == ShardBus::MESSAGE) {
+                    broadcaster.submitMessage(record.source, record.key, std::move(record.payload));
+                } else if (record.kind == ShardBus::DEPARTED) {
+                    // the shard of the client sends the deletes of its entities as messages
+                    broadcaster.forget(record.source, record.entities);
+                    for (const auto &key: record.entities) {
+                        replicator.forgetEntity(key);
+                    }
+                }
+            }
+        } catch (std::exception &e) {
+            std::cout << "Shard " << index << " bus error: " << e.what() << std::endl;
+        }
+    }
+
+public:
+    /**
+     * Binds the sockets of the shard, before any client connects.
+     * @param base where the clients of the server connect to, the shard is at ShardEndpoint::of(base, index)
+     */
+    Shard(zmq::context_t &context, const int index, const ServerConfig &config, const std::string &base)
+        : context(context), index(index), config(config), base(base), endpoint(ShardEndpoint::of(base, index)),
+          clients(config.clientTimeout),
+          broadcaster(replicator, config.tickRate, config.interestRadius), authority(config.maxSpeed),
+          frontend(context, ZMQ_ROUTER), backend(context, ZMQ_DEALER), bus(context, ZMQ_SUB) {
+        frontend.bind(endpoint);
+        backend.bind(backendEndpoint());
+        bus.set(zmq::sockopt::subscribe, "");
+        bus.bind(ShardBus::endpoint(endpoint));
+    }
+
+    // starts the workers and the listener of the bus, the threads stay until the process exits
+    void start(Send_Strategy *send_strategy, WorldBootstrap &bootstrap) {
+        for (int i = 0; i < config.workers; i++) {
+            auto &worker = workers.emplace_back(std::make_unique<Worker>(
+                context, ZMQ_DEALER, "WORKER" + std::to_string(index) + "." + std::to_string(i), backendEndpoint(),
+                ShardBus::Publisher(context, base, index, config.shards)));
+            std::thread(&Worker::work, worker.get(), send_strategy, std::ref(clients), std::ref(replicator),
+                        std::ref(broadcaster), std::ref(bootstrap), std::ref(authority)).detach();
+        }
+        if (config.shards > 1) {
+            std::thread(&Shard::listen, this).detach();
+        }
+    }
+
+    // forwards between the clients and the workers, blocks until the context is closed
+    void proxy() {
+        try {
+            zmq::proxy(zmq::socket_ref(frontend), zmq::socket_ref(backend), nullptr);
+        } catch (std::exception &e) {
+            std::cout << "Shard " << index << " error: " << e.what() << std::endl;
+        }
+    }
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <zmq.hpp>
+
+#include "client_registry.hpp"
+#include "../helpers/byte_buffer.hpp"
+#include "../helpers/network_stats.hpp"
+#include "../helpers/shard_endpoint.hpp"
+#include "../model/components.hpp"
+
+/**
+ * Carries what the clients of one front end shard sent to the other shards of the server, so a client gets the whole
+ * world whichever shard it is connected to. Every shard binds a SUB socket at its endpoint that its listener reads,
+ * every worker publishes what it submits to its own shard through a PUB socket connected to all the others. A record
+ * is a header frame, u8 Kind | varint source length | source | fields of the kind, and for a MESSAGE the payload as a
+ * second frame. That frame is a zmq copy of the one the local snapshot sends, which only adds a reference to the buffer
+ * of a large payload, a small one is copied. The PUB socket does not drop silently: a TRANSFORM that a shard has no
+ * room for is dropped and counted in NetworkStats under BUS_PEER, as the next one of the entity replaces it anyway,
+ * while a MESSAGE or DEPARTED waits for the room, so creates, deletes and departures always reach every shard.
+ */
+namespace ShardBus {
+    enum Kind : uint8_t {
+        TRANSFORM = 1, // key, the Transform as six floats
+        MESSAGE = 2, // entity id
+        DEPARTED = 3, // varint count, the keys of the entities of the client that left
+    };
+
+    // what the records dropped by the bus are counted under
+    constexpr auto BUS_PEER = "shard bus";
+
+    // the bus of the shard the clients connect to at shardEndpoint, unique as long as that is
+    inline std::string endpoint(const std::string &shardEndpoint) {
+        return "inproc://shade-shard-bus@" + shardEndpoint;
+    }
+
+    struct Record {
+        Kind kind;
+        std::string source;
+        std::string key; // the entity id of a MESSAGE
+        Transform transform{};
+        zmq::message_t payload;
+        std::vector<std::string> entities;
+    };
+
+    class Publisher {
+        zmq::socket_t socket;
+        bool connected = false;
+        std::string header;
+        std::shared_ptr<NetworkStats::PeerStats> stats;
+
+        // a droppable record is dropped when a shard has no room for it, the others wait until it has
+        void send(zmq::message_t *payload, const bool droppable) {
+            zmq::message_t frame(header.data(), header.size());
+            const auto more = payload != nullptr ? zmq::send_flags::sndmore : zmq::send_flags::none;
+            if (!socket.send(frame, droppable ? more | zmq::send_flags::dontwait : more)) {
+                NetworkStats::dropped(*stats);
+                return;
+            }
+            // the rest of an accepted message always goes out
+            if (payload != nullptr) {
+                (void) socket.send(*payload, zmq::send_flags::none);
+            }
+        }
+
+    public:
+        /**
+         * Publishes to every shard of the server at base (see ShardEndpoint) but its own, to none for a server with a
+         * single shard.
+         */
+        Publisher(zmq::context_t &context, const std::string &base, const int shard, const int shards)
+            : socket(context, ZMQ_PUB) {
+            // a full subscriber makes the send fail or wait instead of losing the record
+            socket.set(zmq::sockopt::xpub_nodrop, true);
+            for (int other = 0; other < shards; other++) {
+                if (other == shard) continue;
+                socket.connect(endpoint(ShardEndpoint::of(base, other)));
+                connected = true;
+            }
+            if (connected) stats = networkStats().peer(BUS_PEER);
+        }
+
+        void transform(const std::string &source, const std::string &key, const Transform &transform) {
+            if (!connected) return;
+            header.clear();
+            ByteWriter writer(header);
+            writer.u8(TRANSFORM);
+            writer.string(source);
+            writer.string(key);
+            for (const float field: {
+                     transform.x, transform.y, transform.h, transform.w, transform.orientation, transform.scale
+                 }) {
+                writer.f32(field);
+            }
+            send(nullptr, true);
+        }
+
+        void message(const std::string &source, const std::string &entityId, zmq::message_t &payload) {
+            if (!connected) return;
+            header.clear();
+            ByteWriter writer(header);
+            writer.u8(MESSAGE);
+            writer.string(source);
+            writer.string(entityId);
+            zmq::message_t shared;
+            shared.copy(payload);
+            send(&shared, false);
+        }
+
+        void departed(const ClientRegistry::Departed &departed) {
+            if (!connected) return;
+            header.clear();
+            ByteWriter writer(header);
+            writer.u8(DEPARTED);
+            writer.string(departed.client);
+            writer.varint(departed.entities.size());
+            for (const auto &key: departed.entities) {
+                writer.string(key);
+            }
+            send(nullptr, false);
+        }
+    };
+
+    // the next record on a SUB socket of the bus, blocks until there is one
+    inline Record receive(zmq::socket_t &socket) {
+        zmq::message_t frame;
+        if (!socket.recv(frame, zmq::recv_flags::none)) throw std::runtime_error("Shard bus receive interrupted");
+        ByteReader reader(frame.data(), frame.size());
+        Record record;
+        record.kind = static_cast<Kind>(reader.u8());
+        record.source = reader.string();
+        if (record.kind == TRANSFORM) {
+            record.key = reader.string();
+            for (float *field: {
+                     &record.transform.x, &record.transform.y, &record.transform.h, &record.transform.w,
+                     &record.transform.orientation, &record.transform.scale
+                 }) {
+                *field = reader.f32();
+            }
+        } else if (record.kind == MESSAGE) {
+            record.key = reader.string();
+        } else if (record.kind == DEPARTED) {
+            const auto count = reader.varint();
+            for (uint64_t i = 0; i < count; i++) {
+                record.entities.push_back(reader.string());
+            }
+        }
+        if (frame.more()) {
+            (void) socket.recv(record.payload, zmq::recv_flags::none);
+        }
+        return record;
+    }
+}
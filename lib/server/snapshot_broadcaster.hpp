@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <zmq.hpp>
+
+#include "client_registry.hpp"
+#include "interest_grid.hpp"
+#include "transform_replicator.hpp"
+#include "../helpers/network_helper.hpp"
+#include "../strategy/snapshot_frame.hpp"
+
+/**
+ * Collects what the workers receive during a tick and sends every client a single SnapshotFrame per tick instead of
+ * one message per entity update. Only the latest Transform of an entity within a tick is kept, other messages are
+ * kept in order. Shared by all workers, whichever worker notices the tick is due flushes it through its own socket.
+ * Once a client announced its player, it only gets the Transforms of the entities in its area of interest (see
+ * InterestGrid) and is told when one enters or leaves it. A client that falls behind gets fewer snapshots with the
+ * ticks in between coalesced (see ClientQueue) rather than gaps where its snapshots were dropped. A new client gets
+ * nothing until the world it starts from goes out as the first part of its first snapshot. Every snapshot is stamped
+ * with the time of its tick, so clients interpolate on the times the states were sent rather than when they arrived.
+ */
+class SnapshotBroadcaster {
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingTransform {
+        std::string source;
+        Transform transform;
+    };
+
+    struct PendingAuthority {
+        uint32_t sequence;
+        bool corrected;
+        Transform transform;
+    };
+
+    struct PendingMessage {
+        std::string source;
+        std::string entityId;
+        zmq::message_t payload;
+    };
+
+    /**
+     * What a client is sent. A client that falls behind gets a snapshot only every interval ticks, in between the
+     * ticks are coalesced into the queue: the newest state of every entity, the messages in order and the newest
+     * authority record of every predicted entity.
+     */
+    struct ClientQueue {
+        int interval = 1;
+        int skipped = 0; // ticks since the last snapshot
+        int calm = 0; // snapshots in a row the client kept up with
+        bool queued = false;
+        std::unordered_map<std::string, PendingTransform> transforms{};
+        std::string messages{};
+        std::unordered_map<std::string, PendingAuthority> authorities{};
+    };
+
+    // the longest a congested client waits for a snapshot, in ticks
+    static constexpr int MAX_INTERVAL = 8;
+    // snapshots a client has to keep up with before its interval shrinks again
+    static constexpr int CALM_SNAPSHOTS = 5;
+
+    TransformReplicator &replicator;
+    const Clock::duration tick;
+    // what the ticks are stamped relative to
+    const Clock::time_point started = Clock::now();
+
+    std::mutex pendingMutex;
+    std::unordered_map<std::string, PendingTransform> transforms;
+    std::vector<PendingMessage> messages;
+    std::unordered_map<std::string, std::string> anchors;
+    std::unordered_map<std::string, std::unordered_map<std::string, PendingAuthority> > authorities;
+    std::unordered_map<std::string, NetworkHelper::Payload> bootstraps;
+
+    std::mutex flushMutex;
+    Clock::time_point nextTick;
+    InterestGrid interest;
+    // frames reused by every snapshot, the route of a client is built when it gets its first one
+    std::unordered_map<std::string, NetworkHelper::Route> routes;
+    std::unordered_map<std::string, ClientQueue> queues;
+    // the clients whose bootstrap went out, the others are registered but not sent anything yet
+    std::unordered_set<std::string> welcomed;
+    zmq::message_t snapshotId{NetworkHelper::SNAPSHOT_ID};
+    // scratch buffers of sendSnapshot
+    std::string delta;
+    std::vector<std::string> entered;
+    std::vector<std::string> left;
+
+    // appends the records of the messages of the tick that did not come from the client, or all of them for nullptr
+    static void appendMessages(std::string &part, const std::vector<PendingMessage> &tickMessages,
+                               const std::string *client) {
+        for (const auto &message: tickMessages) {
+            if (client != nullptr && message.source == *client) continue;
+            SnapshotFrame::appendMessage(part, message.entityId, message.payload.to_string_view());
+        }
+    }
+
+    static NetworkHelper::Payload messagesPart(const std::vector<PendingMessage> &tickMessages,
+                                               const std::string *client) {
+        std::string part;
+        appendMessages(part, tickMessages, client);
+        return NetworkHelper::makePayload(std::move(part));
+    }
+
+    static void enqueue(ClientQueue &queue, const std::string &client,
+                        const std::unordered_map<std::string, PendingTransform> &tickTransforms,
+                        const std::vector<PendingMessage> &tickMessages,
+                        const std::unordered_map<std::string, PendingAuthority> *tickAuthorities) {
+        queue.queued = true;
+        for (const auto &[key, pending]: tickTransforms) {
+            queue.transforms.insert_or_assign(key, pending);
+        }
+        appendMessages(queue.messages, tickMessages, &client);
+        if (tickAuthorities == nullptr) return;
+        for (const auto &[key, authority]: *tickAuthorities) {
+            auto &queued = queue.authorities[key];
+            queued = PendingAuthority{authority.sequence, authority.corrected || queued.corrected, authority.transform};
+        }
+    }
+
+    /**
+     * Changes how often the client gets a snapshot by how far it is behind: the updates of an entity it has not
+     * acknowledged yet. Keeping up means about a round trip worth of snapshots in flight, twice that and the interval
+     * doubles, a while of keeping up and it shrinks by a tick again.
+     */
+    void adapt(const std::string &client, ClientQueue &queue) const {
+        const auto rttMicros = std::max<int64_t>(networkStats().rttOf(client), 0);
+        const auto tickMicros = std::chrono::duration_cast<std::chrono::microseconds>(tick).count();
+        const auto expected = 2 + static_cast<size_t>(rttMicros / std::max<int64_t>(tickMicros * queue.interval, 1));
+        const auto lag = replicator.lag(client);
+        const int previous = queue.interval;
+        if (lag > 2 * expected) {
+            queue.interval = std::min(queue.interval * 2, MAX_INTERVAL);
+            queue.calm = 0;
+        } else if (lag <= expected && queue.interval > 1 && ++queue.calm >= CALM_SNAPSHOTS) {
+            queue.interval--;
+            queue.calm = 0;
+        }
+        if (queue.interval != previous) networkStats().intervalChanged(client, queue.interval);
+    }
+
+    /**
+     * The snapshot of the client with the given states as of tickTime, its own authority records and the messages of
+     * others, after the world for the first snapshot of a client (bootstrap).
+     */
+    void sendSnapshot(zmq::socket_t &socket, const std::string &client, const Clock::time_point tickTime,
+                      const std::unordered_map<std::string, PendingTransform> &states,
+                      const std::unordered_map<std::string, PendingAuthority> *ownAuthorities,
+                      NetworkHelper::Payload &messagesOfOthers, NetworkHelper::Payload &bootstrap,
+                      const NetworkStats::Clock::time_point start) {
+        // only a snapshot of nothing but states may be dropped, the next one has newer states
+        bool droppable = bootstrap.empty();
+        std::string frame;
+        const auto sinceStart = std::chrono::duration_cast<std::chrono::milliseconds>(tickTime - started);
+        SnapshotFrame::appendTick(frame, sinceStart.count());
+        if (ownAuthorities != nullptr) {
+            for (const auto &[key, authority]: *ownAuthorities) {
+                SnapshotFrame::appendAuthority(frame, key, authority.sequence, authority.corrected,
+                                               authority.transform);
+            }
+        }
+        if (interest.filters(client)) {
+            entered.clear();
+            left.clear();
+            interest.update(client, entered, left);
+            droppable = entered.empty() && left.empty();
+            for (const auto &key: left) {
+                SnapshotFrame::appendInterest(frame, key, false);
+            }
+            for (const auto &key: entered) {
+                SnapshotFrame::appendInterest(frame, key, true);
+                appendTransform(frame, client, key, *interest.transformOf(key));
+            }
+            for (const auto &[key, pending]: states) {
+                if (!interest.isVisible(client, key) ||
+                    std::find(entered.begin(), entered.end(), key) != entered.end()) {
+                    continue;
+                }
+                appendTransform(frame, client, key, pending.transform);
+            }
+        } else {
+            for (const auto &[key, pending]: states) {
+                if (pending.source == client) continue;
+                appendTransform(frame, client, key, pending.transform);
+            }
+        }
+
+        auto own = NetworkHelper::makePayload(std::move(frame));
+        networkStats().encoded("snapshot", start);
+        NetworkHelper::sendShared(socket, routeTo(client), snapshotId, {&bootstrap, &messagesOfOthers, &own},
+                                  droppable && messagesOfOthers.empty());
+    }
+
+    NetworkHelper::Route &routeTo(const std::string &client) {
+        auto it = routes.find(client);
+        if (it == routes.end()) {
+            it = routes.emplace(client, NetworkHelper::routeTo(client)).first;
+        }
+        return it->second;
+    }
+
+    // appends the update of an entity the client keeps getting, or the full entity it just started to get
+    void appendTransform(std::string &frame, const std::string &client, const std::string &key,
+                         const Transform &transform) {
+        // every client gets the position relative to the last one it acknowledged
+        delta.clear();
+        if (replicator.encode(client, key, transform, delta)) {
+            SnapshotFrame::appendDelta(frame, delta);
+        }
+    }
+
+public:
+    /**
+     * @param interestRadius pixels around a client's player it gets updates for, 0 sends every update to everyone
+     */
+    SnapshotBroadcaster(TransformReplicator &replicator, const int tickRate, const float interestRadius)
+        : replicator(replicator),
+          tick(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / tickRate))),
+          nextTick(Clock::now() + tick), interest(interestRadius) {
+    }
+
+    // the latest transform of the entity, sent to every client but source in the next snapshot
+    void submitTransform(const std::string &source, const std::string &key, const Transform &transform) {
+        std::lock_guard lock(pendingMutex);
+        transforms.insert_or_assign(key, PendingTransform{source, transform});
+    }
+
+    // a message forwarded as is to every client but source in the next snapshot, the payload is kept without a copy
+    void submitMessage(const std::string &source, const std::string &entityId, zmq::message_t &&payload) {
+        std::lock_guard lock(pendingMutex);
+        messages.push_back(PendingMessage{source, entityId, std::move(payload)});
+    }
+
+    // tells the client which of its updates of a predicted entity the server processed last and the state it accepted
+    void submitAuthority(const std::string &client, const std::string &key, const uint32_t sequence,
+                         const bool corrected, const Transform &transform) {
+        std::lock_guard lock(pendingMutex);
+        auto &authority = authorities[client][key];
+        // a correction stays a correction until the client got it
+        authority = PendingAuthority{sequence, corrected || authority.corrected, transform};
+    }
+
+    // the world a new client starts from, its first snapshot and nothing before it
+    void submitBootstrap(const std::string &client, NetworkHelper::Payload &&part) {
+        std::lock_guard lock(pendingMutex);
+        bootstraps.insert_or_assign(client, std::move(part));
+    }
+
+    // the entity the area of interest of the client is centered on
+    void setAnchor(const std::string &client, const std::string &key) {
+        std::lock_guard lock(pendingMutex);
+        anchors.insert_or_assign(client, key);
+    }
+
+    /**
+     * Drops everything kept for a client that left and for the entities it had sent. Waits for a flush in progress,
+     * the client must already be unregistered so no later flush sends it anything.
+     */
+    void forget(const std::string &client, const std::vector<std::string> &entities) {
+        {
+            std::lock_guard lock(pendingMutex);
+            for (const auto &key: entities) {
+                transforms.erase(key);
+            }
+            anchors.erase(client);
+            authorities.erase(client);
+            bootstraps.erase(client);
+        }
+        std::lock_guard lock(flushMutex);
+        interest.forget(client);
+        for (const auto &key: entities) {
+            interest.remove(key);
+        }
+        routes.erase(client);
+        queues.erase(client);
+        welcomed.erase(client);
+        for (auto &[other, queue]: queues) {
+            for (const auto &key: entities) {
+                queue.transforms.erase(key);
+            }
+        }
+    }
+
+    // how long a worker may block before the next snapshot is due
+    std::chrono::milliseconds untilNextTick() {
+        std::lock_guard lock(flushMutex);
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(nextTick - Clock::now());
+        return std::max(remaining, std::chrono::milliseconds(0));
+    }
+
+    /**
+     * Sends the snapshots of the tick if it is due. Returns immediately when the tick is not due yet or another
+     * worker is already flushing it.
+     */
+    void flush(zmq::socket_t &socket, const ClientRegistry &clients) {
+        std::unique_lock flushLock(flushMutex, std::try_to_lock);
+        if (!flushLock.owns_lock()) return;
+        const auto now = Clock::now();
+        if (now < nextTick) return;
+        nextTick += tick;
+        // a stall longer than a tick does not make up for the missed ticks
+        if (nextTick < now) nextTick = now + tick;
+
+        std::unordered_map<std::string, PendingTransform> tickTransforms;
+        std::vector<PendingMessage> tickMessages;
+        std::unordered_map<std::string, std::string> tickAnchors;
+        std::unordered_map<std::string, std::unordered_map<std::string, PendingAuthority> > tickAuthorities;
+        std::unordered_map<std::string, NetworkHelper::Payload> tickBootstraps; {
+            std::lock_guard lock(pendingMutex);
+            tickTransforms.swap(transforms);
+            tickMessages.swap(messages);
+            tickAnchors.swap(anchors);
+            tickAuthorities.swap(authorities);
+            tickBootstraps.swap(bootstraps);
+        }
+        for (const auto &[client, key]: tickAnchors) {
+            interest.setAnchor(client, key);
+        }
+        networkStats().backlogMeasured(tickTransforms.size() + tickMessages.size());
+        const bool anyQueued = std::any_of(queues.begin(), queues.end(), [](const auto &entry) {
+            return entry.second.queued;
+        });
+        if (tickTransforms.empty() && tickMessages.empty() && tickBootstraps.empty() && !anyQueued) return;
+        if (interest.enabled()) {
+            for (const auto &[key, pending]: tickTransforms) {
+                interest.move(key, pending.source, pending.transform);
+            }
+        }
+
+        const auto recipients = clients.recipients();
+
+        // the messages are encoded once per tick and shared by the snapshots of all clients that did not send any
+        std::unordered_set<std::string> sources;
+        for (const auto &message: tickMessages) {
+            sources.insert(message.source);
+        }
+        auto common = messagesPart(tickMessages, nullptr);
+
+        NetworkHelper::Payload noBootstrap;
+        for (const auto &client: recipients) {
+            const auto start = NetworkStats::Clock::now();
+            const auto bootstrap = tickBootstraps.find(client);
+            const bool first = bootstrap != tickBootstraps.end();
+            // registered by a worker that has not submitted its bootstrap yet
+            if (!first && !welcomed.contains(client)) continue;
+            auto &world = first ? bootstrap->second : noBootstrap;
+            auto &queue = queues[client];
+            // the bootstrap goes out this tick whatever the interval
+            if (first) queue.skipped = std::max(queue.skipped, queue.interval - 1);
+            const auto own = tickAuthorities.find(client);
+            const auto *ownAuthorities = own != tickAuthorities.end() ? &own->second : nullptr;
+            if (++queue.skipped < queue.interval || queue.queued) {
+                enqueue(queue, client, tickTransforms, tickMessages, ownAuthorities);
+            }
+            if (queue.skipped < queue.interval) continue;
+
+            if (queue.queued) {
+                auto queuedMessages = NetworkHelper::makePayload(std::move(queue.messages));
+                sendSnapshot(socket, client, now, queue.transforms, &queue.authorities, queuedMessages, world, start);
+                queue = ClientQueue{.interval = queue.interval, .calm = queue.calm};
+            } else if (sources.contains(client)) {
+                auto messagesOfOthers = messagesPart(tickMessages, &client);
+                sendSnapshot(socket, client, now, tickTransforms, ownAuthorities, messagesOfOthers, world, start);
+                queue.skipped = 0;
+            } else {
+                sendSnapshot(socket, client, now, tickTransforms, ownAuthorities, common, world, start);
+                queue.skipped = 0;
+            }
+            if (first) welcomed.insert(client);
+            adapt(client, queue);
+        }
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "../strategy/transform_delta.hpp"
+
+/**
+ * Server side of the Transform delta stream. For every client and entity it remembers the last state the client
+ * acknowledged and the states sent since, so every update only carries the fields that differ from what that client
+ * is known to have. Shared by all workers.
+ */
+class TransformReplicator {
+    // unacknowledged states kept per client and entity before falling back to sending the full state
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+
+    struct Baseline {
+        uint32_t nextSequence = 1;
+        uint32_t ackedSequence = 0;
+        TransformDelta::Fields acked{};
+        std::deque<std::pair<uint32_t, TransformDelta::Fields> > inFlight;
+    };
+
+    Quantization quantization;
+    std::mutex mutex;
+    std::unordered_map<std::string, uint32_t> netIds;
+    std::unordered_map<std::string, std::unordered_map<uint32_t, Baseline> > clients;
+
+    uint32_t netIdOf(const std::string &key) {
+        const auto [it, inserted] = netIds.try_emplace(key, static_cast<uint32_t>(netIds.size() + 1));
+        return it->second;
+    }
+
+public:
+    explicit TransformReplicator(const Quantization &quantization = {}) : quantization(quantization) {
+    }
+
+    /**
+     * Appends the update of the entity for the client to out. Returns false when there is nothing to send because
+     * the client already acknowledged this state, up to the quantization.
+     */
+    bool encode(const std::string &client, const std::string &key, const Transform &transform, std::string &out) {
+        const auto fields = quantization.quantize(transform);
+        std::lock_guard lock(mutex);
+        const auto netId = netIdOf(key);
+        auto &baseline = clients[client][netId];
+        if (baseline.inFlight.size() >= MAX_IN_FLIGHT) {
+            // the client stopped acknowledging, start over from the full state
+            baseline.ackedSequence = 0;
+            baseline.inFlight.clear();
+        }
+        if (baseline.ackedSequence != 0 && baseline.inFlight.empty() &&
+            TransformDelta::changedFields(baseline.acked, fields) == 0) {
+            return false;
+        }
+        const auto sequence = baseline.nextSequence++;
+        TransformDelta::encode(out, netId, baseline.ackedSequence == 0 ? &key : nullptr, sequence,
+                               baseline.ackedSequence, baseline.acked, fields);
+        baseline.inFlight.emplace_back(sequence, fields);
+        return true;
+    }
+
+    // applies the acknowledgements a client sent for the updates it received
+    void acknowledge(const std::string &client, const std::string_view acks) {
+        ByteReader reader(acks.data(), acks.size());
+        std::lock_guard lock(mutex);
+        auto &baselines = clients[client];
+        while (!reader.done()) {
+            const auto netId = static_cast<uint32_t>(reader.varint());
+            const auto sequence = static_cast<uint32_t>(reader.varint());
+            const auto it = baselines.find(netId);
+            if (it == baselines.end() || sequence <= it->second.ackedSequence) continue;
+            auto &baseline = it->second;
+            while (!baseline.inFlight.empty() && baseline.inFlight.front().first <= sequence) {
+                if (baseline.inFlight.front().first == sequence) {
+                    baseline.acked = baseline.inFlight.front().second;
+                    baseline.ackedSequence = sequence;
+                }
+                baseline.inFlight.pop_front();
+            }
+        }
+    }
+
+    // how far the client is behind: the most updates of one entity it has not acknowledged yet
+    size_t lag(const std::string &client) {
+        std::lock_guard lock(mutex);
+        const auto it = clients.find(client);
+        if (it == clients.end()) return 0;
+        size_t lag = 0;
+        for (const auto &[netId, baseline]: it->second) {
+            lag = std::max(lag, baseline.inFlight.size());
+        }
+        return lag;
+    }
+
+    void forget(const std::string &client) {
+        std::lock_guard lock(mutex);
+        clients.erase(client);
+    }
+
+    // drops what every client had of a deleted entity, its net id is not reused
+    void forgetEntity(const std::string &key) {
+        std::lock_guard lock(mutex);
+        const auto it = netIds.find(key);
+        if (it == netIds.end()) return;
+        for (auto &[client, baselines]: clients) {
+            baselines.erase(it->second);
+        }
+    }
+};
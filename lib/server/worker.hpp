@@ -6,12 +6,18 @@
 #define WORKER_HPP
 
 #include <iostream>
-#include <unordered_set>
 #include <utility>
 #include <zmq.hpp>
 
+#include "client_registry.hpp"
+#include "movement_authority.hpp"
+#include "shard_bus.hpp"
+#include "snapshot_broadcaster.hpp"
+#include "transform_replicator.hpp"
+#include "world_bootstrap.hpp"
 #include "../enum/enum.hpp"
 #include "../helpers/network_helper.hpp"
+#include "../model/event.hpp"
 #include "../strategy/send_strategy.hpp"
 
 
@@ -22,56 +28,189 @@ class Worker {
     zmq::socket_t worker;
     Timeline timeline;
     std::string id;
+    std::string backend;
+    // what this worker submits goes to the other shards too
+    ShardBus::Publisher publisher;
+
+    /**
+     * Reads the type of an event and the key and transform of the entity a PositionChanged or MainCharCreated event
+     * carries, and the sequence and teleported flag of a PositionChanged. False for any other message.
+     */
+    static bool parseEntityEvent(Send_Strategy *send_strategy, zmq::message_t &message, std::string &type,
+                                 std::string &key, Transform &transform, uint32_t &sequence, bool &teleported) {
+        try {
+            const Event event = send_strategy->parse_event(message);
+            type = event.type;
+            if (type == eventTypeToString(EventType::PositionChanged)) {
+                auto data = event.data.get<PositionChangedData>();
+                key = std::move(data.entity_key);
+                transform = data.transform;
+                sequence = data.sequence;
+                teleported = data.teleported;
+                return true;
+            }
+            if (type != eventTypeToString(EventType::MainCharCreated)) {
+                return false;
+            }
+            auto data = event.data.get<MainCharCreatedData>();
+            for (const auto &component: data.components) {
+                if (std::holds_alternative<Transform>(component)) {
+                    key = std::move(data.entity_key);
+                    transform = std::get<Transform>(component);
+                    return true;
+                }
+            }
+            return false;
+        } catch (std::exception &e) {
+            return false;
+        }
+    }
+
+    // the round trip time the client measured last, sent along with its ping
+    static void reportRtt(const std::string &client, const zmq::message_t &ping) {
+        try {
+            ByteReader reader(ping.data(), ping.size());
+            reader.svarint();
+            networkStats().rttMeasured(client, reader.svarint());
+        } catch (std::exception &e) {
+            std::cerr << "Malformed ping from " << client << std::endl;
+        }
+    }
+
+    void submitMessage(SnapshotBroadcaster &broadcaster, const std::string &source, const std::string &entityId,
+                       zmq::message_t &&payload) {
+        publisher.message(source, entityId, payload);
+        broadcaster.submitMessage(source, entityId, std::move(payload));
+    }
+
+    // deletes the entities of a client that left on everyone else and drops what the server kept for it
+    void evict(const ClientRegistry::Departed &departed, Send_Strategy *send_strategy, TransformReplicator &replicator,
+               SnapshotBroadcaster &broadcaster, MovementAuthority &authority) {
+        broadcaster.forget(departed.client, departed.entities);
+        replicator.forget(departed.client);
+        publisher.departed(departed);
+        for (const auto &key: departed.entities) {
+            replicator.forgetEntity(key);
+            authority.forget(key);
+            submitMessage(broadcaster, departed.client, key,
+                          NetworkHelper::takeMessage(send_strategy->get_delete_message(key)));
+        }
+        networkStats().forget(departed.client);
+        std::cout << "Client " << departed.client << " left, deleted " << departed.entities.size() << " entities"
+                << std::endl;
+    }
+
+    // handles one message or event of a client, updates go out with the next snapshot instead of right away
+    void handle(Send_Strategy *send_strategy, ClientRegistry &clients, SnapshotBroadcaster &broadcaster,
+                MovementAuthority &authority, const std::string &client, const std::string &entityId,
+                zmq::message_t &&data) {
+        std::string type;
+        std::string key;
+        Transform transform{};
+        uint32_t sequence = 0;
+        bool teleported = false;
+        const bool isEntityEvent = entityId == NetworkHelper::EVENT_ENTITY_ID &&
+                                   parseEntityEvent(send_strategy, data, type, key, transform, sequence, teleported);
+        if (isEntityEvent && sequence != 0) {
+            // a predicted entity, the server decides its state and tells the client what it decided
+            bool corrected = false;
+            // a respawn or the end of a replay is not movement the speed limit applies to
+            if (teleported) authority.forget(key);
+            transform = authority.authorize(key, transform, sequence, corrected);
+            broadcaster.submitAuthority(client, key, sequence, corrected, transform);
+        }
+        if (isEntityEvent) {
+            clients.own(client, key);
+            broadcaster.submitTransform(client, key, transform);
+            publisher.transform(client, key, transform);
+        }
+        if (isEntityEvent && type == eventTypeToString(EventType::MainCharCreated)) {
+            // the player of the client, its area of interest follows it
+            broadcaster.setAnchor(client, key);
+        }
+        if (!isEntityEvent || type != eventTypeToString(EventType::PositionChanged)) {
+            submitMessage(broadcaster, client, entityId, std::move(data));
+        }
+    }
 
 public:
-    Worker(zmq::context_t &context, int socket_type, std::string id) : context(context), worker(context, socket_type),
-                                                                       timeline(nullptr, 1000), id(std::move(id)) {
+    /**
+     * @param backend the endpoint of the DEALER socket of its shard the worker gets the messages of the clients from
+     */
+    Worker(zmq::context_t &context, int socket_type, std::string id, std::string backend,
+           ShardBus::Publisher publisher) : context(context), worker(context, socket_type), timeline(nullptr, 1000),
+                                            id(std::move(id)), backend(std::move(backend)),
+                                            publisher(std::move(publisher)) {
     }
 
-    void work(Send_Strategy *send_strategy, std::unordered_set<std::string> &clients, std::shared_mutex &mutex) {
+    void work(Send_Strategy *send_strategy, ClientRegistry &clients, TransformReplicator &replicator,
+              SnapshotBroadcaster &broadcaster, WorldBootstrap &bootstrap, MovementAuthority &authority) {
         worker.set(zmq::sockopt::routing_id, id);
-        worker.connect("tcp://localhost:5571");
+        worker.connect(backend);
 
         try {
             while (true) {
+                // wake up for the next tick even when no client sends anything
+                zmq::pollitem_t items[] = {{static_cast<void *>(worker), 0, ZMQ_POLLIN, 0}};
+                zmq::poll(items, 1, broadcaster.untilNextTick());
+                for (const auto &departed: clients.removeExpired()) {
+                    evict(departed, send_strategy, replicator, broadcaster, authority);
+                }
+                broadcaster.flush(worker, clients);
+                if (!(items[0].revents & ZMQ_POLLIN)) {
+                    continue;
+                }
+
                 zmq::message_t identity;
                 zmq::message_t entity_id;
                 zmq::message_t entity_data;
 
 
-                NetworkHelper::receiveMessageServer(worker, identity, entity_id, entity_data); {
-                    std::shared_lock<std::shared_mutex> read_lock(mutex);
-                    if (clients.find(identity.to_string()) == clients.end()) {
-                        read_lock.unlock();
+                NetworkHelper::receiveMessageServer(worker, identity, entity_id, entity_data);
 
-
-                        // send all entities to new client
-                        for (const auto &entity: gCoordinator.getEntityIds()) {
-                                auto message = send_strategy->get_message(entity.second, Message::CREATE);
-
-                                NetworkHelper::sendMessageServer(worker, identity.to_string(), entity.first, message);
-                        }
+                if (entity_id.to_string() == NetworkHelper::ACK_ID) {
+                    // acks come from the reply socket whose identity is the client's with an R appended
+                    auto client = identity.to_string();
+                    client.pop_back();
+                    clients.refresh(client);
+                    replicator.acknowledge(client, entity_data.to_string_view());
+                    continue;
+                }
+                if (entity_id.to_string() == NetworkHelper::PING_ID) {
+                    // pings come from the reply socket too, the client measures its round trip time on the pong and
+                    // reports the last one in the ping
+                    auto client = identity.to_string();
+                    client.pop_back();
+                    clients.refresh(client);
+                    reportRtt(client, entity_data);
+                    NetworkHelper::sendMessageServer(worker, client, NetworkHelper::PONG_ID, entity_data.to_string());
+                    continue;
+                }
+                if (entity_id.to_string() == NetworkHelper::DISCONNECT_ID) {
+                    if (const auto departed = clients.remove(identity.to_string())) {
+                        evict(*departed, send_strategy, replicator, broadcaster, authority);
                     }
-                } {
-                    std::unique_lock<std::shared_mutex> write_lock(mutex);
-                    clients.insert(identity.to_string());
-                    write_lock.unlock();
+                    continue;
+                }
+                const auto client = identity.to_string();
+                if (clients.touch(client)) {
+                    // all entities go to the new client ahead of anything else it is sent
+                    broadcaster.submitBootstrap(client, bootstrap.snapshotPart(send_strategy));
                 }
 
-
-                std::string received_msg = send_strategy->copy_message(entity_data); {
-                    std::shared_lock<std::shared_mutex> read_lock(mutex);
-                    for (const auto &clientId: clients) {
-                        if (clientId == identity.to_string()) {
-                            continue;
-                        }
-
-                        NetworkHelper::sendMessageServer(worker, clientId, entity_id.to_string(), received_msg);
+                if (entity_id.to_string() == NetworkHelper::EVENT_BATCH_ID) {
+                    try {
+                        NetworkHelper::forEachBatchedEvent(entity_data, [&](const std::string_view event) {
+                            handle(send_strategy, clients, broadcaster, authority, client,
+                                   NetworkHelper::EVENT_ENTITY_ID, zmq::message_t(event.data(), event.size()));
+                        });
+                    } catch (std::exception &e) {
+                        std::cerr << "Malformed event batch from " << client << std::endl;
                     }
+                    continue;
                 }
-
-
-                // Process further
+                handle(send_strategy, clients, broadcaster, authority, client, entity_id.to_string(),
+                       std::move(entity_data));
             }
         } catch (std::exception &e) {
             std::cout << "Worker error: " << e.what() << std::endl;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <zmq.hpp>
+
+#include "../ECS/coordinator.hpp"
+#include "../helpers/network_helper.hpp"
+#include "../model/components.hpp"
+#include "../strategy/send_strategy.hpp"
+#include "../strategy/snapshot_frame.hpp"
+
+extern Coordinator gCoordinator;
+
+/**
+ * The CREATE messages of every entity of the world packed into one snapshot part behind a WELCOME record, the first
+ * part of the first snapshot a client gets after it connects (see SnapshotBroadcaster::submitBootstrap) instead of one
+ * message per entity. The part is cached, the bootstrap watches gCoordinator for entities that are created, destroyed
+ * or change their components and only encodes those entries again when the next client joins, so a join costs as much
+ * as the world changed since the last one rather than a scan of the world. Systems that move an entity through
+ * getComponent mark it with Coordinator::changed. Shared by all workers. A bootstrap without a world never reads
+ * gCoordinator, for a server in a process whose entities are not its world, its part only welcomes the client.
+ */
+class WorldBootstrap {
+    const bool withWorld;
+    std::mutex mutex;
+    // the CREATE message of every entity by key
+    std::unordered_map<std::string, std::string> entries;
+    NetworkHelper::Payload part;
+
+    std::optional<size_t> watcher;
+    // taken by the watcher with gCoordinator locked, so it is never held while calling into it
+    std::mutex dirtyMutex;
+    // the entities changed since the last refresh by key, empty for the destroyed ones
+    std::unordered_map<std::string, std::optional<Entity> > dirty;
+
+    // encodes the changed entries again, true if there were any
+    bool refresh(Send_Strategy *send_strategy) {
+        std::unordered_map<std::string, std::optional<Entity> > changed;
+        {
+            std::lock_guard lock(dirtyMutex);
+            changed.swap(dirty);
+        }
+        for (const auto &[key, entity]: changed) {
+            if (!entity) {
+                entries.erase(key);
+                continue;
+            }
+            entries.insert_or_assign(key, send_strategy->get_message(*entity, Message::CREATE));
+        }
+        return !changed.empty();
+    }
+
+public:
+    explicit WorldBootstrap(const bool withWorld = true) : withWorld(withWorld) {
+        if (!withWorld) return;
+        watcher = gCoordinator.watch([this](const Entity entity, const std::string &key, const bool destroyed) {
+            std::lock_guard lock(dirtyMutex);
+            dirty.insert_or_assign(key, destroyed ? std::nullopt : std::optional(entity));
+        });
+        // the entities created before it watched, what the watcher saw since is newer
+        const auto world = gCoordinator.getEntityIds();
+        std::lock_guard lock(dirtyMutex);
+        for (const auto &[key, entity]: world) {
+            dirty.try_emplace(key, entity);
+        }
+    }
+
+    ~WorldBootstrap() {
+        if (watcher) gCoordinator.unwatch(*watcher);
+    }
+
+    /**
+     * The world as a snapshot part for a client that just connected, sharing the frames of the cached part. The client
+     * creates the entities as if their CREATE messages had arrived one by one.
+     */
+    NetworkHelper::Payload snapshotPart(Send_Strategy *send_strategy) {
+        std::lock_guard lock(mutex);
+        const auto start = NetworkStats::Clock::now();
+        const bool changed = withWorld && refresh(send_strategy);
+        if (changed || part.empty()) {
+            std::string frame;
+            SnapshotFrame::appendWelcome(frame);
+            for (const auto &[key, message]: entries) {
+                SnapshotFrame::appendMessage(frame, key, message);
+            }
+            part = NetworkHelper::makePayload(std::move(frame));
+        }
+        networkStats().encoded("bootstrap", start);
+        return part.share();
+    }
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "quantization.hpp"
+#include "send_strategy.hpp"
+#include "../helpers/byte_buffer.hpp"
+#include "../model/event.hpp"
+
+/**
+ * Binary wire format. A message is
+ *   u8 Message type | varint key length | key | u8 component count | components
+ * and every component is a one byte tag followed by a fixed little endian layout of its fields. Transform and
+ * CKinematic fields are quantized to the configured fixed point precision and sent as zigzag varints, an orientation of
+ * up to 8 bits as one byte. Events are the type as a length prefixed string followed by the payload in msgpack, where
+ * a "transform" or "components" field is msgpack bin holding the components in the layout of a message. The payload
+ * of PositionChanged, sent for every move of every player, is a fixed layout instead:
+ *   varint key length | key | Transform fields without a tag | varint sequence | u8 teleported
+ */
+class Binary_Strategy : public Send_Strategy {
+    Quantization quantization;
+
+    static void writeField(ByteWriter &writer, const float value, const float step) {
+        if (step == 0) {
+            writer.f32(value);
+        } else {
+            writer.svarint(Quantization::quantize(value, step));
+        }
+    }
+
+    static float readField(ByteReader &reader, const float step) {
+        if (step == 0) return reader.f32();
+        return Quantization::restore(static_cast<int32_t>(reader.svarint()), step);
+    }
+
+    void writeOrientation(ByteWriter &writer, const float orientation) const {
+        if (quantization.orientationBits == 0) {
+            writer.f32(orientation);
+        } else if (quantization.orientationBits <= 8) {
+            writer.u8(static_cast<uint8_t>(quantization.quantizeOrientation(orientation)));
+        } else {
+            writer.varint(static_cast<uint32_t>(quantization.quantizeOrientation(orientation)));
+        }
+    }
+
+    float readOrientation(ByteReader &reader) const {
+        if (quantization.orientationBits == 0) return reader.f32();
+        if (quantization.orientationBits <= 8) return quantization.restoreOrientation(reader.u8());
+        return quantization.restoreOrientation(static_cast<int32_t>(reader.varint()));
+    }
+
+public:
+    explicit Binary_Strategy(const Quantization &quantization = {}) : quantization(quantization) {
+    }
+
+    enum ComponentTag : uint8_t {
+        TRANSFORM = 1,
+        COLOR = 2,
+        RIGID_BODY = 3,
+        COLLISION = 4,
+        KINEMATIC = 5,
+        DESTROY = 6,
+        VERTICAL_BOOST = 7,
+    };
+
+    void writeComponent(ByteWriter &writer, const Transform &transform) const {
+        writer.u8(TRANSFORM);
+        writeTransform(writer, transform);
+    }
+
+    void writeTransform(ByteWriter &writer, const Transform &transform) const {
+        writeField(writer, transform.x, quantization.position);
+        writeField(writer, transform.y, quantization.position);
+        writeField(writer, transform.h, quantization.size);
+        writeField(writer, transform.w, quantization.size);
+        writeOrientation(writer, transform.orientation);
+        writeField(writer, transform.scale, quantization.scale);
+    }
+
+    static void writeComponent(ByteWriter &writer, const Color &color) {
+        writer.u8(COLOR);
+        writer.u8(color.color.r);
+        writer.u8(color.color.g);
+        writer.u8(color.color.b);
+        writer.u8(color.color.a);
+    }
+
+    static void writeComponent(ByteWriter &writer, const RigidBody &rigidBody) {
+        writer.u8(RIGID_BODY);
+        writer.f32(rigidBody.mass);
+        writer.f32(rigidBody.drag);
+        writer.f32(rigidBody.angular_drag);
+        writer.f32(rigidBody.gravity_scale);
+    }
+
+    static void writeComponent(ByteWriter &writer, const Collision &collision) {
+        writer.u8(COLLISION);
+        writer.u8(static_cast<uint8_t>(collision.isCollider | collision.isTrigger << 1));
+        writer.u8(static_cast<uint8_t>(collision.layer));
+    }
+
+    void writeComponent(ByteWriter &writer, const CKinematic &kinematic) const {
+        writer.u8(KINEMATIC);
+        writeField(writer, kinematic.velocity.x, quantization.velocity);
+        writeField(writer, kinematic.velocity.y, quantization.velocity);
+        writeField(writer, kinematic.rotation, quantization.rotation);
+        writeField(writer, kinematic.acceleration.x, quantization.velocity);
+        writeField(writer, kinematic.acceleration.y, quantization.velocity);
+        writeField(writer, kinematic.angular_acceleration, quantization.rotation);
+    }
+
+    static void writeComponent(ByteWriter &writer, const Destroy &destroy) {
+        writer.u8(DESTROY);
+        writer.svarint(destroy.slot);
+        writer.u8(static_cast<uint8_t>(destroy.destroy | destroy.isSent << 1));
+    }
+
+    static void writeComponent(ByteWriter &writer, const VerticalBoost &verticalBoost) {
+        writer.u8(VERTICAL_BOOST);
+        writer.f32(verticalBoost.velocity);
+    }
+
+    // the components a message can carry, others are left out and not counted
+    void writeComponents(std::string &out, const std::vector<SERIALIZABLE_COMPONENTS> &components) const {
+        ByteWriter writer(out);
+        const size_t countAt = out.size();
+        writer.u8(0);
+        uint8_t count = 0;
+        for (const auto &component: components) {
+            std::visit([&](const auto &value) {
+                if constexpr (requires { writeComponent(writer, value); }) {
+                    writeComponent(writer, value);
+                    count++;
+                }
+            }, component);
+        }
+        out[countAt] = static_cast<char>(count);
+    }
+
+    SERIALIZABLE_COMPONENTS readComponent(ByteReader &reader) const {
+        switch (reader.u8()) {
+            case TRANSFORM:
+                return readTransform(reader);
+            case COLOR: {
+                Color color{};
+                color.color.r = reader.u8();
+                color.color.g = reader.u8();
+                color.color.b = reader.u8();
+                color.color.a = reader.u8();
+                return color;
+            }
+            case RIGID_BODY: {
+                RigidBody rigidBody{};
+                rigidBody.mass = reader.f32();
+                rigidBody.drag = reader.f32();
+                rigidBody.angular_drag = reader.f32();
+                rigidBody.gravity_scale = reader.f32();
+                return rigidBody;
+            }
+            case COLLISION: {
+                const auto flags = reader.u8();
+                return Collision{(flags & 1) != 0, (flags & 2) != 0, static_cast<CollisionLayer>(reader.u8())};
+            }
+            case KINEMATIC: {
+                CKinematic kinematic{};
+                kinematic.velocity.x = readField(reader, quantization.velocity);
+                kinematic.velocity.y = readField(reader, quantization.velocity);
+                kinematic.rotation = readField(reader, quantization.rotation);
+                kinematic.acceleration.x = readField(reader, quantization.velocity);
+                kinematic.acceleration.y = readField(reader, quantization.velocity);
+                kinematic.angular_acceleration = readField(reader, quantization.rotation);
+                return kinematic;
+            }
+            case DESTROY: {
+                Destroy destroy{};
+                destroy.slot = static_cast<int>(reader.svarint());
+                const auto flags = reader.u8();
+                destroy.destroy = (flags & 1) != 0;
+                destroy.isSent = (flags & 2) != 0;
+                return destroy;
+            }
+            case VERTICAL_BOOST:
+                return VerticalBoost{reader.f32()};
+            default:
+                throw std::runtime_error("Unknown component tag");
+        }
+    }
+
+    Transform readTransform(ByteReader &reader) const {
+        Transform transform{};
+        transform.x = readField(reader, quantization.position);
+        transform.y = readField(reader, quantization.position);
+        transform.h = readField(reader, quantization.size);
+        transform.w = readField(reader, quantization.size);
+        transform.orientation = readOrientation(reader);
+        transform.scale = readField(reader, quantization.scale);
+        return transform;
+    }
+
+    // a component count followed by that many components
+    std::vector<SERIALIZABLE_COMPONENTS> readComponents(ByteReader &reader) const {
+        std::vector<SERIALIZABLE_COMPONENTS> components;
+        const auto count = reader.u8();
+        components.reserve(count);
+        for (int i = 0; i < count; i++) {
+            components.emplace_back(readComponent(reader));
+        }
+        return components;
+    }
+
+    template<typename T>
+    void writeIfPresent(ByteWriter &writer, const Entity entity, uint8_t &count) const {
+        if (gCoordinator.hasComponent<T>(entity)) {
+            writeComponent(writer, gCoordinator.getComponent<T>(entity));
+            count++;
+        }
+    }
+
+    std::string get_message(Entity entity, Message type) override {
+        std::string message;
+        message.reserve(64);
+        ByteWriter writer(message);
+        writer.u8(static_cast<uint8_t>(type));
+        writer.string(gCoordinator.getEntityKey(entity));
+        const size_t countAt = writer.size();
+        writer.u8(0);
+        uint8_t count = 0;
+        if (type == CREATE) {
+            writeIfPresent<Transform>(writer, entity, count);
+            writeIfPresent<Color>(writer, entity, count);
+            writeIfPresent<RigidBody>(writer, entity, count);
+            writeIfPresent<Collision>(writer, entity, count);
+            writeIfPresent<CKinematic>(writer, entity, count);
+            writeIfPresent<Destroy>(writer, entity, count);
+            writeIfPresent<VerticalBoost>(writer, entity, count);
+        } else if (type == UPDATE) {
+            writeIfPresent<Transform>(writer, entity, count);
+        }
+        message[countAt] = static_cast<char>(count);
+        return message;
+    }
+
+    std::string get_delete_message(const std::string &entity_key) override {
+        std::string message;
+        ByteWriter writer(message);
+        writer.u8(static_cast<uint8_t>(DELETE));
+        writer.string(entity_key);
+        writer.u8(0);
+        return message;
+    }
+
+    SimpleMessage parse_message(const std::string_view message) override {
+        ByteReader reader(message.data(), message.size());
+        SimpleMessage parsed;
+        parsed.type = static_cast<Message>(reader.u8());
+        parsed.entity_key = reader.string();
+        const auto count = reader.u8();
+        for (int i = 0; i < count; i++) {
+            parsed.components.emplace_back(readComponent(reader));
+        }
+        return parsed;
+    }
+
+    SimpleMessage parse_message(zmq::message_t &message) override {
+        return parse_message(message.to_string_view());
+    }
+
+    std::string copy_message(zmq::message_t &message) override {
+        return message.to_string();
+    }
+
+    std::string get_event(Event &event) override {
+        std::string message;
+        ByteWriter writer(message);
+        writer.string(event.type);
+        if (event.type == positionChanged()) {
+            const PositionChangedData data = event.data;
+            writer.string(data.entity_key);
+            writeTransform(writer, data.transform);
+            writer.varint(data.sequence);
+            writer.u8(data.teleported);
+            return message;
+        }
+        const auto &data = event.data;
+        const bool packed = data.is_object() && (data.contains("transform") || data.contains("components"));
+        const auto payload = nlohmann::json::to_msgpack(packed ? packComponents(data) : data);
+        writer.bytes(payload.data(), payload.size());
+        return message;
+    }
+
+    Event parse_event(zmq::message_t &message) override {
+        ByteReader reader(message.data(), message.size());
+        Event event;
+        event.type = reader.string();
+        if (event.type == positionChanged()) {
+            PositionChangedData data;
+            data.entity_key = reader.string();
+            data.transform = readTransform(reader);
+            data.sequence = static_cast<uint32_t>(reader.varint());
+            data.teleported = reader.u8() != 0;
+            event.data = data;
+            return event;
+        }
+        const auto payload = reader.rest();
+        event.data = nlohmann::json::from_msgpack(payload.begin(), payload.end());
+        if (event.data.is_object()) unpackComponents(event.data);
+        return event;
+    }
+
+private:
+    static const std::string &positionChanged() {
+        static const std::string type = eventTypeToString(EventType::PositionChanged);
+        return type;
+    }
+
+    static nlohmann::json::binary_t toBinary(const std::string &bytes) {
+        return nlohmann::json::binary_t(std::vector<uint8_t>(bytes.begin(), bytes.end()));
+    }
+
+    // the event data with its transform and components replaced by their binary layout
+    nlohmann::json packComponents(const nlohmann::json &data) const {
+        nlohmann::json packed = data;
+        std::string bytes;
+        if (const auto it = packed.find("transform"); it != packed.end() && it->is_object()) {
+            ByteWriter writer(bytes);
+            writeComponent(writer, it->get<Transform>());
+            *it = toBinary(bytes);
+        }
+        if (const auto it = packed.find("components"); it != packed.end() && it->is_object()) {
+            bytes.clear();
+            writeComponents(bytes, it->get<std::vector<SERIALIZABLE_COMPONENTS> >());
+            *it = toBinary(bytes);
+        }
+        return packed;
+    }
+
+    void unpackComponents(nlohmann::json &data) const {
+        if (const auto it = data.find("transform"); it != data.end() && it->is_binary()) {
+            ByteReader reader(it->get_binary().data(), it->get_binary().size());
+            *it = std::get<Transform>(readComponent(reader));
+        }
+        if (const auto it = data.find("components"); it != data.end() && it->is_binary()) {
+            ByteReader reader(it->get_binary().data(), it->get_binary().size());
+            *it = readComponents(reader);
+        }
+    }
+};
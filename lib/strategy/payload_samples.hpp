@@ -0,0 +1,75 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../ECS/coordinator.hpp"
+#include "../helpers/compression.hpp"
+#include "../model/components.hpp"
+#include "../model/event.hpp"
+#include "../helpers/network_helper.hpp"
+#include "send_strategy.hpp"
+#include "snapshot_frame.hpp"
+
+extern Coordinator gCoordinator;
+
+namespace Strategy {
+    /**
+     * Typical payloads in the selected format: CREATE, UPDATE and DELETE messages of a few entities, the events that
+     * carry them and a snapshot part made of them. They only depend on the format, so the client and the server
+     * generate the same ones. Uses the components both of them register and must run before any system is
+     * registered, the entities are gone again when it returns.
+     */
+    inline std::vector<std::string> samplePayloads(Send_Strategy *send_strategy) {
+        std::vector<std::string> samples;
+        std::vector<Entity> created;
+        std::string part;
+        // keys that look like the random ones of Coordinator::createKey, but the same every time
+        std::mt19937 generator(581);
+        const std::string alphanum = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        for (int i = 0; i < 8; i++) {
+            std::string key;
+            for (int c = 0; c < 12; c++) key += alphanum[generator() % alphanum.size()];
+            const auto entity = gCoordinator.createEntity(key);
+            created.push_back(entity);
+            const auto offset = static_cast<float>(i * 50);
+            gCoordinator.addComponent(entity, Transform{100 + offset, 600 - offset, 32, 32, 0, 1});
+            gCoordinator.addComponent(entity, Color{{static_cast<Uint8>(i * 30), 255, 0, 255}});
+            gCoordinator.addComponent(entity, RigidBody{i % 2 == 0 ? -1.f : 1.f, 0, 0, 1});
+            gCoordinator.addComponent(entity, Collision{true, false, i % 2 == 0 ? MOVING_PLATFORM : PLAYER});
+            gCoordinator.addComponent(entity, CKinematic{});
+            gCoordinator.addComponent(entity, Destroy{});
+
+            const auto create = send_strategy->get_message(entity, Message::CREATE);
+            const auto update = send_strategy->get_message(entity, Message::UPDATE);
+            samples.push_back(create);
+            samples.push_back(update);
+            samples.push_back(send_strategy->get_message(entity, Message::DELETE));
+            SnapshotFrame::appendMessage(part, key, create);
+
+            // fixed entity ids, the real ones differ between client and server
+            Event mainCharCreated{
+                eventTypeToString(EventType::MainCharCreated), MainCharCreatedData{0, key, creationComponents(entity)}
+            };
+            samples.push_back(send_strategy->get_event(mainCharCreated));
+            Event moved{
+                eventTypeToString(EventType::PositionChanged),
+                PositionChangedData{key, gCoordinator.getComponent<Transform>(entity), static_cast<uint32_t>(i + 1)}
+            };
+            samples.push_back(send_strategy->get_event(moved));
+            SnapshotFrame::appendMessage(part, NetworkHelper::EVENT_ENTITY_ID, samples.back());
+        }
+        samples.push_back(std::move(part));
+        for (const auto entity: created) {
+            gCoordinator.destroyEntity(entity);
+        }
+        return samples;
+    }
+
+    // reads the compression settings and trains the dictionary on samplePayloads
+    inline void setupCompression(Send_Strategy *send_strategy) {
+        Compression::configureFromEnvironment();
+        Compression::dictionary() = Compression::trainDictionary(samplePayloads(send_strategy));
+    }
+}
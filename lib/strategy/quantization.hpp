@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#include "../model/components.hpp"
+
+/**
+ * Fixed point precision of the replicated fields. A value is sent as the integer number of steps, so a position that
+ * moved 2.5 pixels at 1/16 pixel precision costs a single varint byte instead of a float. A step of 0 (or 0
+ * orientation bits) keeps the exact float bits. Sender and receiver must use the same settings, restoring is a
+ * multiplication by the step and therefore deterministic.
+ */
+struct Quantization {
+    float position = 1.f / 16; // x and y, in pixels
+    float size = 1.f / 16; // w and h
+    int orientationBits = 8; // orientation in degrees, one full turn is split in 2^orientationBits steps
+    float scale = 1.f / 256;
+    float velocity = 1.f / 16; // CKinematic velocity and acceleration, in pixels per second
+    float rotation = 1.f / 16;
+
+    // sends every field as the exact float
+    static Quantization none() {
+        return {0, 0, 0, 0, 0, 0};
+    }
+
+    [[nodiscard]] static int32_t quantize(const float value, const float step) {
+        if (step == 0) return std::bit_cast<int32_t>(value);
+        const double steps = std::round(static_cast<double>(value) / step);
+        return static_cast<int32_t>(std::clamp(steps, static_cast<double>(INT32_MIN), static_cast<double>(INT32_MAX)));
+    }
+
+    [[nodiscard]] static float restore(const int32_t value, const float step) {
+        if (step == 0) return std::bit_cast<float>(value);
+        return static_cast<float>(value) * step;
+    }
+
+    [[nodiscard]] int32_t quantizeOrientation(const float degrees) const {
+        if (orientationBits == 0) return std::bit_cast<int32_t>(degrees);
+        const double turns = degrees / 360.0 - std::floor(degrees / 360.0);
+        return static_cast<int32_t>(std::lround(turns * (1 << orientationBits))) & ((1 << orientationBits) - 1);
+    }
+
+    [[nodiscard]] float restoreOrientation(const int32_t value) const {
+        if (orientationBits == 0) return std::bit_cast<float>(value);
+        return static_cast<float>(value) * 360.f / static_cast<float>(1 << orientationBits);
+    }
+
+    // x, y, h, w, orientation, scale in the order of the Transform fields
+    [[nodiscard]] std::array<int32_t, 6> quantize(const Transform &transform) const {
+        return {
+            quantize(transform.x, position), quantize(transform.y, position), quantize(transform.h, size),
+            quantize(transform.w, size), quantizeOrientation(transform.orientation), quantize(transform.scale, scale)
+        };
+    }
+
+    [[nodiscard]] Transform restore(const std::array<int32_t, 6> &fields) const {
+        Transform transform{};
+        transform.x = restore(fields[0], position);
+        transform.y = restore(fields[1], position);
+        transform.h = restore(fields[2], size);
+        transform.w = restore(fields[3], size);
+        transform.orientation = restoreOrientation(fields[4]);
+        transform.scale = restore(fields[5], scale);
+        return transform;
+    }
+};
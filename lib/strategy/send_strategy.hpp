@@ -6,6 +6,7 @@
 #define SEND_STRATEGY_HPP
 
 #include "../ECS/types.hpp"
+#include "../EMS/types.hpp"
 #include "../enum/enum.hpp"
 #include "../model/components.hpp"
 #include "../model/data_model.hpp"
@@ -17,8 +18,14 @@ public:
 
     virtual std::string get_message(Entity entity, Message type) = 0;
 
+    // the DELETE message of an entity only known by its key, the server deletes the entities of clients that left
+    virtual std::string get_delete_message(const std::string &entity_key) = 0;
+
     virtual SimpleMessage parse_message(zmq::message_t &message) = 0;
 
+    // parses a message that was carried inside an event instead of arriving as its own frame
+    virtual SimpleMessage parse_message(std::string_view message) = 0;
+
     virtual std::string copy_message(zmq::message_t &message) = 0;
 
     virtual Event parse_event(zmq::message_t &message) = 0;
@@ -28,6 +35,33 @@ public:
 
 extern Coordinator gCoordinator;
 
+// the components of an entity another process needs to create it, what a CREATE message carries
+inline std::vector<SERIALIZABLE_COMPONENTS> creationComponents(const Entity entity) {
+    std::vector<SERIALIZABLE_COMPONENTS> components;
+    if (gCoordinator.hasComponent<Transform>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<Transform>(entity));
+    }
+    if (gCoordinator.hasComponent<Color>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<Color>(entity));
+    }
+    if (gCoordinator.hasComponent<RigidBody>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<RigidBody>(entity));
+    }
+    if (gCoordinator.hasComponent<Collision>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<Collision>(entity));
+    }
+    if (gCoordinator.hasComponent<CKinematic>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<CKinematic>(entity));
+    }
+    if (gCoordinator.hasComponent<Destroy>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<Destroy>(entity));
+    }
+    if (gCoordinator.hasComponent<VerticalBoost>(entity)) {
+        components.emplace_back(gCoordinator.getComponent<VerticalBoost>(entity));
+    }
+    return components;
+}
+
 class JSON_Strategy : public Send_Strategy {
 public:
     std::string get_message(Entity entity, Message type) override {
@@ -40,27 +74,7 @@ public:
             json = json_message;
         }
         else if (type == CREATE) {
-            if (gCoordinator.hasComponent<Transform>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<Transform>(entity));
-            }
-            if (gCoordinator.hasComponent<Color>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<Color>(entity));
-            }
-            if (gCoordinator.hasComponent<RigidBody>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<RigidBody>(entity));
-            }
-            if (gCoordinator.hasComponent<Collision>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<Collision>(entity));
-            }
-            if (gCoordinator.hasComponent<CKinematic>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<CKinematic>(entity));
-            }
-            if (gCoordinator.hasComponent<Destroy>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<Destroy>(entity));
-            }
-            if(gCoordinator.hasComponent<VerticalBoost>(entity)) {
-                json_message.components.emplace_back(gCoordinator.getComponent<VerticalBoost>(entity));
-            }
+            json_message.components = creationComponents(entity);
             json = json_message;
         }
         else if (type == UPDATE) {
@@ -72,10 +86,21 @@ public:
         return json.dump();
     }
 
+    std::string get_delete_message(const std::string &entity_key) override {
+        SimpleMessage json_message{};
+        json_message.type = DELETE;
+        json_message.entity_key = entity_key;
+        const nlohmann::json json = json_message;
+        return json.dump();
+    }
+
     SimpleMessage parse_message(zmq::message_t &message) override {
+        return parse_message(message.to_string_view());
+    }
+
+    SimpleMessage parse_message(const std::string_view message) override {
         try {
-            std::string jsonString(static_cast<char *>(message.data()), message.size());
-            const nlohmann::json received_msg = nlohmann::json::parse(jsonString);
+            const nlohmann::json received_msg = nlohmann::json::parse(message);
             SimpleMessage jMsg = received_msg;
             return jMsg;
         } catch (std::exception &e) {
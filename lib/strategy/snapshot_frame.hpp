@@ -0,0 +1,143 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "../helpers/byte_buffer.hpp"
+#include "../model/components.hpp"
+
+/**
+ * A snapshot is everything the server has for one client in one tick, sent as one multipart message. The messages of
+ * the tick are one part that is shared by the snapshots of all clients, the client's own records another. Every part
+ * is a sequence of records:
+ *   u8 DELTA   | varint length | Transform delta (see TransformDelta)
+ *   u8 MESSAGE | varint length | entity id | varint length | payload   (a message the server used to forward alone)
+ *   u8 ENTER   | varint length | entity key   (the entity came into the client's area of interest)
+ *   u8 LEAVE   | varint length | entity key   (the entity left it, no more updates until it enters again)
+ *   u8 AUTHORITY | varint length | entity key | varint sequence | u8 corrected | 6 x f32 Transform
+ *              (the server processed the client's own updates of a predicted entity up to sequence)
+ *   u8 WELCOME   (the server registered the client, anew if it had dropped it, and starts replicating from scratch)
+ *   u8 TICK | varint milliseconds   (the server's clock when it sent the snapshot, the deltas after it are as of then)
+ * Messages keep the order they were received in and their part comes first, so an entity created in a tick exists
+ * before its first update is applied.
+ */
+namespace SnapshotFrame {
+    enum RecordKind : uint8_t {
+        DELTA = 1,
+        MESSAGE = 2,
+        ENTER = 3,
+        LEAVE = 4,
+        AUTHORITY = 5,
+        WELCOME = 6,
+        TICK = 7,
+    };
+
+    // the server's state of an entity the client predicts, see Predicted
+    struct Authority {
+        std::string_view key;
+        uint32_t sequence;
+        bool corrected;
+        Transform transform;
+    };
+
+    inline void appendDelta(std::string &frame, const std::string_view delta) {
+        ByteWriter writer(frame);
+        writer.u8(DELTA);
+        writer.string(delta);
+    }
+
+    inline void appendMessage(std::string &frame, const std::string_view entityId, const std::string_view payload) {
+        ByteWriter writer(frame);
+        writer.u8(MESSAGE);
+        writer.string(entityId);
+        writer.string(payload);
+    }
+
+    inline void appendInterest(std::string &frame, const std::string_view key, const bool entered) {
+        ByteWriter writer(frame);
+        writer.u8(entered ? ENTER : LEAVE);
+        writer.string(key);
+    }
+
+    inline void appendAuthority(std::string &frame, const std::string_view key, const uint32_t sequence,
+                                const bool corrected, const Transform &transform) {
+        ByteWriter writer(frame);
+        writer.u8(AUTHORITY);
+        writer.string(key);
+        writer.varint(sequence);
+        writer.u8(corrected);
+        for (const float field: {
+                 transform.x, transform.y, transform.h, transform.w, transform.orientation, transform.scale
+             }) {
+            writer.f32(field);
+        }
+    }
+
+    inline void appendWelcome(std::string &frame) {
+        ByteWriter(frame).u8(WELCOME);
+    }
+
+    inline void appendTick(std::string &frame, const int64_t milliseconds) {
+        ByteWriter writer(frame);
+        writer.u8(TICK);
+        writer.varint(static_cast<uint64_t>(milliseconds));
+    }
+
+    /**
+     * Calls onDelta(delta), onMessage(entityId, payload), onInterest(key, entered), onAuthority(authority),
+     * onWelcome() and onTick(milliseconds) for the records of the frame in order. The views point into the frame.
+     * Throws std::runtime_error on a malformed frame.
+     */
+    template<typename OnDelta, typename OnMessage, typename OnInterest, typename OnAuthority, typename OnWelcome,
+        typename OnTick>
+    void forEach(const std::string_view frame, OnDelta onDelta, OnMessage onMessage, OnInterest onInterest,
+                 OnAuthority onAuthority, OnWelcome onWelcome, OnTick onTick) {
+        ByteReader reader(frame.data(), frame.size());
+        const auto view = [&reader] {
+            const auto size = reader.varint();
+            const auto rest = reader.rest();
+            reader.skip(size);
+            return rest.substr(0, size);
+        };
+        while (!reader.done()) {
+            switch (reader.u8()) {
+                case DELTA:
+                    onDelta(view());
+                    break;
+                case MESSAGE: {
+                    const auto entityId = view();
+                    onMessage(entityId, view());
+                    break;
+                }
+                case ENTER:
+                    onInterest(view(), true);
+                    break;
+                case LEAVE:
+                    onInterest(view(), false);
+                    break;
+                case AUTHORITY: {
+                    Authority authority{};
+                    authority.key = view();
+                    authority.sequence = static_cast<uint32_t>(reader.varint());
+                    authority.corrected = reader.u8() != 0;
+                    authority.transform.x = reader.f32();
+                    authority.transform.y = reader.f32();
+                    authority.transform.h = reader.f32();
+                    authority.transform.w = reader.f32();
+                    authority.transform.orientation = reader.f32();
+                    authority.transform.scale = reader.f32();
+                    onAuthority(authority);
+                    break;
+                }
+                case WELCOME:
+                    onWelcome();
+                    break;
+                case TICK:
+                    onTick(static_cast<int64_t>(reader.varint()));
+                    break;
+                default:
+                    throw std::runtime_error("Unknown snapshot record");
+            }
+        }
+    }
+}
@@ -4,10 +4,19 @@
 
 #ifndef STRATEGY_SELECTOR_HPP
 #define STRATEGY_SELECTOR_HPP
+#include "binary_strategy.hpp"
 #include "send_strategy.hpp"
 
 namespace Strategy {
+    // "binary" selects the quantized binary wire format, "binary-float" the binary format with exact floats and
+    // anything else JSON. Clients and server must use the same format
     static std::unique_ptr<Send_Strategy> select_message_strategy(const std::string &messageFormat) {
+        if (messageFormat == "binary") {
+            return std::make_unique<Binary_Strategy>();
+        }
+        if (messageFormat == "binary-float") {
+            return std::make_unique<Binary_Strategy>(Quantization::none());
+        }
         return std::make_unique<JSON_Strategy>();
     }
 }
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "quantization.hpp"
+#include "../helpers/byte_buffer.hpp"
+#include "../model/components.hpp"
+
+/**
+ * Wire format of a Transform sent as a delta against the last state the receiver acknowledged:
+ *   u8 flags | varint net id | [key] | varint sequence | [varint sequence - base sequence] | changed fields
+ * The low 6 bits of flags mark the changed fields, HAS_KEY is set until the receiver knows the key of the net id and
+ * HAS_BASE when the fields are relative to an acknowledged state instead of a zero Transform. Fields are quantized
+ * (see Quantization) and a changed field is the zigzag varint of the difference in steps, so an entity moving a few
+ * pixels per update costs one byte per axis and fields that did not change, like w and h, cost nothing.
+ * Acknowledgements are a sequence of (varint net id, varint sequence) pairs.
+ */
+namespace TransformDelta {
+    constexpr int FIELDS = 6;
+
+    enum Flags : uint8_t {
+        FIELD_MASK = 0x3f,
+        HAS_KEY = 0x40,
+        HAS_BASE = 0x80,
+    };
+
+    using Fields = std::array<int32_t, FIELDS>;
+
+    // the fields of current that differ from base
+    inline uint8_t changedFields(const Fields &base, const Fields &current) {
+        uint8_t mask = 0;
+        for (int i = 0; i < FIELDS; i++) {
+            if (base[i] != current[i]) mask |= 1 << i;
+        }
+        return mask;
+    }
+
+    /**
+     * @param key written when not null, the receiver learns the net id of the entity from it
+     * @param baseSequence 0 when there is no acknowledged state, base is then ignored
+     */
+    inline void encode(std::string &out, const uint32_t netId, const std::string *key, const uint32_t sequence,
+                       const uint32_t baseSequence, const Fields &base, const Fields &current) {
+        constexpr Fields zero{};
+        const auto &reference = baseSequence != 0 ? base : zero;
+        const uint8_t mask = changedFields(reference, current);
+        ByteWriter writer(out);
+        writer.u8(mask | (key ? HAS_KEY : 0) | (baseSequence != 0 ? HAS_BASE : 0));
+        writer.varint(netId);
+        if (key) writer.string(*key);
+        writer.varint(sequence);
+        if (baseSequence != 0) writer.varint(sequence - baseSequence);
+        for (int i = 0; i < FIELDS; i++) {
+            if (mask & 1 << i) writer.svarint(static_cast<int64_t>(current[i]) - reference[i]);
+        }
+    }
+
+    /**
+     * Client side of the delta stream. Remembers the last states received for every entity so a delta can be applied
+     * to whichever of them the server used as the base.
+     */
+    class Decoder {
+        static constexpr size_t HISTORY = 64;
+
+        struct History {
+            std::string key;
+            uint32_t lastApplied = 0;
+            std::deque<std::pair<uint32_t, Fields> > states;
+        };
+
+        Quantization quantization;
+        std::unordered_map<uint32_t, History> entities;
+
+    public:
+        explicit Decoder(const Quantization &quantization = {}) : quantization(quantization) {
+        }
+
+        struct Update {
+            std::string key;
+            Transform transform;
+        };
+
+        // forgets every entity, for a server that replicates to the client from scratch again
+        void reset() {
+            entities.clear();
+        }
+
+        /**
+         * Decodes one delta and appends its acknowledgement to ack. Returns the new transform unless it is older than
+         * one already applied or its base is unknown.
+         */
+        std::optional<Update> decode(const std::string_view message, std::string &ack) {
+            ByteReader reader(message.data(), message.size());
+            const uint8_t flags = reader.u8();
+            const auto netId = static_cast<uint32_t>(reader.varint());
+            auto &history = entities[netId];
+            if (flags & HAS_KEY) history.key = reader.string();
+            const auto sequence = static_cast<uint32_t>(reader.varint());
+            if (history.key.empty()) return std::nullopt;
+
+            Fields fields{};
+            if (flags & HAS_BASE) {
+                const auto baseSequence = sequence - static_cast<uint32_t>(reader.varint());
+                const auto base = std::find_if(history.states.begin(), history.states.end(), [&](const auto &state) {
+                    return state.first == baseSequence;
+                });
+                if (base == history.states.end()) return std::nullopt;
+                fields = base->second;
+            }
+            for (int i = 0; i < FIELDS; i++) {
+                if (flags & 1 << i) fields[i] = static_cast<int32_t>(fields[i] + reader.svarint());
+            }
+
+            history.states.emplace_back(sequence, fields);
+            if (history.states.size() > HISTORY) history.states.pop_front();
+            ByteWriter writer(ack);
+            writer.varint(netId);
+            writer.varint(sequence);
+
+            if (sequence <= history.lastApplied) return std::nullopt;
+            history.lastApplied = sequence;
+            return Update{history.key, quantization.restore(fields)};
+        }
+    };
+}
@@ -4,22 +4,59 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
-#include <unordered_set>
+#include <map>
+#include <mutex>
 #include <zmq.hpp>
 
 #include "../ECS/coordinator.hpp"
 #include "../ECS/system.hpp"
 #include "../helpers/network_helper.hpp"
 #include "../model/components.hpp"
-#include "../strategy/send_strategy.hpp"
 #include "../model/event.hpp"
+#include "../strategy/send_strategy.hpp"
 
 extern Coordinator gCoordinator;
 
+/**
+ * Sends the Transforms of the synced ClientEntities to the server. The simulation thread publishes a copy of the state
+ * of every entity that changed at the end of a frame, the sender thread sleeps until there are some and sends the
+ * copies in one message, so it never reads the world the simulation is writing and nothing is sent while it is idle.
+ * The players it announced are announced again whenever the server registers the client anew.
+ */
 class ClientSystem : public System {
+    // the sender wakes up this often without changes, so its thread notices the game stopping
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(100);
+
+    // the Transform every entity was last published with, only used by the simulation thread
     std::map<Entity, Transform> previous;
+    // the players created on the server, only used by the simulation thread
+    std::vector<Entity> announced;
     bool isReplaying = false;
+    // the players are where the replay left them, the simulation thread publishes them as teleported
+    std::atomic<bool> replayEnded = false;
+    // set by the network thread, the simulation thread announces the players again
+    std::atomic<bool> rejoined = false;
+
+    // the state of an entity as the simulation thread published it
+    struct Published {
+        std::string key;
+        Transform transform;
+        uint32_t sequence;
+        bool teleported;
+    };
+
+    std::mutex dirtyMutex;
+    std::condition_variable dirtyChanged;
+    // only the newest state of an entity published more than once before the sender got to it is sent
+    std::map<Entity, Published> dirty;
+    std::map<Entity, Published> sending;
+    // MainCharCreated events to send ahead of the states
+    std::vector<std::shared_ptr<Event> > announcements;
 
     EventHandler startReplayHandler = [this](const std::shared_ptr<Event> &event) {
         if (event->type == eventTypeToString(EventType::StartReplaying)) {
@@ -30,42 +67,121 @@ class ClientSystem : public System {
     EventHandler stopReplayHandler = [this](const std::shared_ptr<Event> &event) {
         if (event->type == eventTypeToString(EventType::StopReplaying)) {
             isReplaying = false;
+            replayEnded = true;
         }
     };
 
+    EventHandler rejoinedHandler = [this](const std::shared_ptr<Event> &event) {
+        if (event->type == eventTypeToString(EventType::Rejoined)) {
+            rejoined = true;
+        }
+    };
+
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     ClientSystem() {
-        eventCoordinator.subscribe(startReplayHandler, eventTypeToString(EventType::StartReplaying));
-        eventCoordinator.subscribe(stopReplayHandler, eventTypeToString(EventType::StopReplaying));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(startReplayHandler, eventTypeToString(EventType::StartReplaying)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(stopReplayHandler, eventTypeToString(EventType::StopReplaying)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(rejoinedHandler, eventTypeToString(EventType::Rejoined)));
     }
 
-    ~ClientSystem() {
-        eventCoordinator.unsubscribe(startReplayHandler, eventTypeToString(EventType::StartReplaying));
-        eventCoordinator.unsubscribe(stopReplayHandler, eventTypeToString(EventType::StartReplaying));
+    /**
+     * Called by the simulation thread to create a player of this client on the server and the other clients, with the
+     * components it has now. Its state is published from then on.
+     */
+    void announce(const Entity entity) {
+        if (std::ranges::find(announced, entity) == announced.end()) announced.push_back(entity);
+        auto event = std::make_shared<Event>(Event{
+            eventTypeToString(EventType::MainCharCreated),
+            MainCharCreatedData{entity, gCoordinator.getEntityKey(entity), creationComponents(entity)}
+        });
+        gCoordinator.getComponent<ClientEntity>(entity).synced = true;
+        std::unique_lock lock(dirtyMutex);
+        announcements.push_back(std::move(event));
+        lock.unlock();
+        dirtyChanged.notify_one();
     }
 
-    void update(zmq::socket_t &client_socket, Send_Strategy *send_strategy) {
-        if(isReplaying) return;
-        for (auto entity: entities) {
-            auto &client_entity = gCoordinator.getComponent<ClientEntity>(entity);
-            if (!client_entity.synced) {
-                return;
+    /**
+     * Called by the simulation thread at the end of a frame. Hands the state of the entities whose Transform changed
+     * since they were last published, or that are still to be resent after a sync, to the sender and wakes it up.
+     * After the server registered the client anew the players are announced again and every state is resent.
+     */
+    void publish() {
+        if (isReplaying) return;
+        if (rejoined.exchange(false)) {
+            for (const auto entity: announced) {
+                // destroyed since it was announced
+                if (!gCoordinator.hasComponent<ClientEntity>(entity)) continue;
+                announce(entity);
             }
-            auto &transform = gCoordinator.getComponent<Transform>(entity);
+            previous.clear();
+        }
+        const bool afterReplay = replayEnded.exchange(false);
+        std::vector<std::pair<Entity, Published> > changed;
+        for (auto entity: entities) {
             auto &clientEntity = gCoordinator.getComponent<ClientEntity>(entity);
+            // not announced to the server yet
+            if (!clientEntity.synced) continue;
+            auto &transform = gCoordinator.getComponent<Transform>(entity);
             if (previous[entity].equal(transform) && clientEntity.noOfTimes == 0) {
                 continue;
             }
-            clientEntity.noOfTimes--;
-            clientEntity.noOfTimes = std::max(0, clientEntity.noOfTimes);
-            auto message = send_strategy->get_message(entity, Message::UPDATE);
+            clientEntity.noOfTimes = std::max(0, clientEntity.noOfTimes - 1);
             previous[entity] = transform;
+            // the moves of the world are only seen here, a server bootstraps its clients from it
+            gCoordinator.changed(entity);
+            // the server echoes the sequence of a predicted entity so the client can reconcile it
+            uint32_t sequence = 0;
+            bool teleported = false;
+            if (gCoordinator.hasComponent<Predicted>(entity)) {
+                auto &predicted = gCoordinator.getComponent<Predicted>(entity);
+                sequence = predicted.sequence;
+                teleported = predicted.teleported || afterReplay;
+                predicted.teleported = false;
+            }
+            changed.emplace_back(entity, Published{gCoordinator.getEntityKey(entity), transform, sequence, teleported});
+        }
+        if (changed.empty()) return;
+        std::unique_lock lock(dirtyMutex);
+        for (auto &[entity, published]: changed) {
+            const auto [it, inserted] = dirty.try_emplace(entity, published);
+            if (inserted) continue;
+            // a teleport the sender did not get to yet must not be lost to a newer state
+            published.teleported = published.teleported || it->second.teleported;
+            it->second = std::move(published);
+        }
+        lock.unlock();
+        dirtyChanged.notify_one();
+    }
 
-            Event positionChangedEvent{
+    /**
+     * Called in a loop by the sender thread. Waits for published states and sends the announcements and a
+     * PositionChanged for each state, all in one message, returns after IDLE_WAIT when there are none.
+     */
+    void update(zmq::socket_t &client_socket) {
+        std::vector<std::shared_ptr<Event> > events;
+        {
+            std::unique_lock lock(dirtyMutex);
+            if (!dirtyChanged.wait_for(lock, IDLE_WAIT, [this] { return !dirty.empty() || !announcements.empty(); })) {
+                return;
+            }
+            sending.swap(dirty);
+            events.swap(announcements);
+        }
+        for (auto &[entity, published]: sending) {
+            events.push_back(std::make_shared<Event>(Event{
                 eventTypeToString(EventType::PositionChanged),
-                PositionChangedData{entity, send_strategy->get_message(entity, Message::UPDATE)}
-            };
-            eventCoordinator.emitServer(client_socket, std::make_shared<Event>(positionChangedEvent));
+                PositionChangedData{
+                    std::move(published.key), published.transform, published.sequence, published.teleported
+                }
+            }));
         }
+        eventCoordinator.emitServer(client_socket, events);
+        sending.clear();
     }
 };
@@ -10,6 +10,7 @@
 #include <algorithm>
 
 extern Coordinator gCoordinator;
+extern Timeline eventTimeline;
 
 
 // the following collision algorithm is based on the sweep and prune algorithm for broad phase collision detection and,
@@ -80,9 +81,10 @@ private:
                 a.y + a.h > b.y);
     }
 
+    // Triggers are queued rather than emitted so that repeated overlaps of the same pair coalesce into one event
     static void handleTrigger(Entity triggerEntity, Entity otherEntity) {
         Event event{eventTypeToString(EventType::EntityTriggered), EntityTriggeredData{triggerEntity, otherEntity}};
-        eventCoordinator.emit(std::make_shared<Event>(event));
+        eventCoordinator.queueEvent(std::make_shared<Event>(event), eventTimeline.getElapsedTime(), Priority::MEDIUM);
     }
 
     static void resolveCollision(Entity entityA, Entity entityB) {
@@ -179,13 +179,12 @@ private:
         }
     };
 
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     CollisionHandlerSystem() {
-        eventCoordinator.subscribe(collisionHandler, eventTypeToString(EventType::EntityCollided));
-    }
-
-    ~CollisionHandlerSystem() {
-        eventCoordinator.unsubscribe(collisionHandler, eventTypeToString(EventType::EntityCollided));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(collisionHandler, eventTypeToString(EventType::EntityCollided)));
     }
 };
 
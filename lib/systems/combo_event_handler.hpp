@@ -30,14 +30,16 @@ class ComboEventHandler : public System {
         }
     };
 
+    std::unordered_map<Entity, std::vector<ScopedSubscription> > subscriptions;
+
 public:
-    ComboEventHandler() {
-        eventCoordinator.subscribe(handler, eventTypeToString(EventType::DashRight));
-        eventCoordinator.subscribe(handler, eventTypeToString(EventType::DashLeft));
+    void entityAdded(const Entity entity) override {
+        auto &handles = subscriptions[entity];
+        handles.push_back(eventCoordinator.subscribeScoped(handler, eventTypeToString(EventType::DashRight), entity));
+        handles.push_back(eventCoordinator.subscribeScoped(handler, eventTypeToString(EventType::DashLeft), entity));
     }
 
-    ~ComboEventHandler() {
-        eventCoordinator.subscribe(handler, eventTypeToString(EventType::DashRight));
-        eventCoordinator.subscribe(handler, eventTypeToString(EventType::DashLeft));
+    void entityRemoved(const Entity entity) override {
+        subscriptions.erase(entity);
     }
 };
@@ -18,13 +18,12 @@ class DestroySystem : public System {
         }
     };
 
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     DestroySystem() {
-        eventCoordinator.subscribe(destroyHandler, eventTypeToString(EventType::EntityDestroyed));
-    }
-
-    ~DestroySystem() {
-        eventCoordinator.unsubscribe(destroyHandler, eventTypeToString(EventType::EntityDestroyed));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(destroyHandler, eventTypeToString(EventType::EntityDestroyed)));
     }
 
 
@@ -7,7 +7,7 @@
 #include "../ECS/coordinator.hpp"
 #include "../ECS/system.hpp"
 #include "../EMS/event_coordinator.hpp"
-#include "../strategy/send_strategy.hpp"
+#include "../model/data_model.hpp"
 
 extern Coordinator gCoordinator;
 extern EventCoordinator eventCoordinator;
@@ -16,11 +16,9 @@ extern EventCoordinator eventCoordinator;
 class EntityCreatedHandler : public System {
     EventHandler collisionHandler = [this](const std::shared_ptr<Event> &event) {
         if (event->type == eventTypeToString(EventType::MainCharCreated)) {
-            const MainCharCreatedData &data = event->data;
-            const nlohmann::json received_msg = nlohmann::json::parse(data.message);
-            SimpleMessage msg = received_msg;
-            auto generatedId = gCoordinator.createEntity(msg.entity_key);
-            for (auto &component: msg.components) {
+            const MainCharCreatedData data = event->data;
+            auto generatedId = gCoordinator.createEntity(data.entity_key);
+            for (auto &component: data.components) {
                 if (std::holds_alternative<Transform>(component)) {
                     auto received_transform = std::get<Transform>(component);
                     gCoordinator.addComponent<Transform>(generatedId, received_transform);
@@ -49,12 +47,13 @@ class EntityCreatedHandler : public System {
         }
     };
 
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     EntityCreatedHandler() {
-        eventCoordinator.subscribe(collisionHandler, eventTypeToString(EventType::MainCharCreated));
-    }
-
-    ~EntityCreatedHandler() {
-        eventCoordinator.unsubscribe(collisionHandler, eventTypeToString(EventType::MainCharCreated));
+        // mutates components, so it runs on the main thread even though the receiver thread emits the event
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(collisionHandler, eventTypeToString(EventType::MainCharCreated),
+                                             Executor::MAIN));
     }
 };
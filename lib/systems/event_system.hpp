@@ -16,7 +16,8 @@ class EventSystem : public System {
 
 public:
     void update() {
-        // Process events in the queue
+        // Run handlers of events that other threads emitted for the main thread, then the queued events
+        eventCoordinator.dispatch(Executor::MAIN);
         eventCoordinator.processEventsInQueue(eventTimeline.getElapsedTime());
     }
 };
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+#include "../model/components.hpp"
+
+/**
+ * The last Transforms received for a remote entity with the time the server sent them, on the local clock (see
+ * ServerClock). A remote entity is shown a fixed delay behind the newest update, so there usually is a received state
+ * on both sides of the shown time to interpolate between, and as the states are spaced the way they were sent an
+ * update arriving late or several arriving at once do not make it stutter. When updates stop coming it keeps moving
+ * with its last velocity for a short while and then stays where it is.
+ */
+class InterpolationBuffer {
+    static constexpr size_t CAPACITY = 32;
+
+    struct Sample {
+        int64_t time;
+        Transform transform;
+    };
+
+    std::deque<Sample> samples;
+
+    static float lerp(const float from, const float to, const float t) {
+        return from + (to - from) * t;
+    }
+
+    // turns the short way round
+    static float lerpAngle(const float from, const float to, const float t) {
+        const float difference = std::remainder(to - from, 360.f);
+        return from + difference * t;
+    }
+
+    static Transform interpolate(const Transform &from, const Transform &to, const float t) {
+        Transform transform = to;
+        transform.x = lerp(from.x, to.x, t);
+        transform.y = lerp(from.y, to.y, t);
+        transform.h = lerp(from.h, to.h, t);
+        transform.w = lerp(from.w, to.w, t);
+        transform.orientation = lerpAngle(from.orientation, to.orientation, t);
+        transform.scale = lerp(from.scale, to.scale, t);
+        return transform;
+    }
+
+public:
+    // time in milliseconds, a state older than the newest one is ignored
+    void push(const int64_t time, const Transform &transform) {
+        if (!samples.empty() && time < samples.back().time) return;
+        samples.push_back(Sample{time, transform});
+        if (samples.size() > CAPACITY) samples.pop_front();
+    }
+
+    void clear() {
+        samples.clear();
+    }
+
+    /**
+     * The Transform at time. Past the newest sample it is extrapolated from the last two for at most maxExtrapolation
+     * milliseconds. Empty when nothing was received yet.
+     */
+    [[nodiscard]] std::optional<Transform> sample(const int64_t time, const int64_t maxExtrapolation) const {
+        if (samples.empty()) return std::nullopt;
+        if (time <= samples.front().time) return samples.front().transform;
+
+        const auto next = std::upper_bound(samples.begin(), samples.end(), time, [](const int64_t t, const Sample &s) {
+            return t < s.time;
+        });
+        if (next != samples.end()) {
+            const auto &previous = *(next - 1);
+            const float t = static_cast<float>(time - previous.time) / static_cast<float>(next->time - previous.time);
+            return interpolate(previous.transform, next->transform, t);
+        }
+
+        const auto &last = samples.back();
+        if (samples.size() < 2) return last.transform;
+        const auto &before = samples[samples.size() - 2];
+        if (last.time == before.time) return last.transform;
+        const auto ahead = std::min(time - last.time, maxExtrapolation);
+        const float t = 1.f + static_cast<float>(ahead) / static_cast<float>(last.time - before.time);
+        return interpolate(before.transform, last.transform, t);
+    }
+
+    // drops the samples that can no longer be shown, keeping the one before time to interpolate from
+    void discardBefore(const int64_t time) {
+        while (samples.size() > 2 && samples[1].time <= time) {
+            samples.pop_front();
+        }
+    }
+};
@@ -8,6 +8,7 @@
 #include "../ECS/coordinator.hpp"
 #include "../ECS/system.hpp"
 #include "../EMS/event_coordinator.hpp"
+#include "../helpers/network_stats.hpp"
 #include "../model/components.hpp"
 
 extern Timeline gameTimeline;
@@ -49,6 +50,15 @@ private:
                     }
                     break;
                 }
+                case SDL_SCANCODE_6: {
+                    eventCoordinator.toggleTrace("event_trace.json");
+                    break;
+                }
+                case SDL_SCANCODE_7: {
+                    eventCoordinator.dumpStats(std::cout);
+                    networkStats().dump(std::cout);
+                    break;
+                }
                 case SDL_SCANCODE_8: {
                     Event startReplayEvent{eventTypeToString(EventType::StartRecording), {}};
                     eventCoordinator.emit(std::make_shared<Event>(startReplayEvent));
@@ -91,14 +101,17 @@ private:
         }
     };
 
+    // input events are routed to the entity they belong to, so we only listen to the entities of this system
+    std::unordered_map<Entity, ScopedSubscription> subscriptions;
+
 public:
-    KeyboardSystem() {
-        eventCoordinator.subscribe(keyboardHandler, eventTypeToString(EventType::EntityInput));
+    void entityAdded(const Entity entity) override {
+        subscriptions[entity] = eventCoordinator.subscribeScoped(keyboardHandler,
+                                                                 eventTypeToString(EventType::EntityInput), entity);
     }
 
-    ~KeyboardSystem() {
-        // unsubscribe keyboard events when the system is destroyed
-        eventCoordinator.unsubscribe(keyboardHandler, eventTypeToString(EventType::EntityInput));
+    void entityRemoved(const Entity entity) override {
+        subscriptions.erase(entity);
     }
 };
 
@@ -38,6 +38,8 @@ public:
         prevKeyState[SDL_SCANCODE_A] = false;
         prevKeyState[SDL_SCANCODE_LSHIFT] = false;
         prevKeyState[SDL_SCANCODE_SPACE] = false;
+        prevKeyState[SDL_SCANCODE_6] = false;
+        prevKeyState[SDL_SCANCODE_7] = false;
         prevKeyState[SDL_SCANCODE_8] = false;
         prevKeyState[SDL_SCANCODE_9] = false;
         prevKeyState[SDL_SCANCODE_0] = false;
@@ -25,7 +25,7 @@ public:
                 EventType::ReplayTransformChanged,
                 ReplayTransformData{entity, transform}
             };
-            eventCoordinator.emit(std::make_shared<Event>(transformChangedEvent));
+            eventCoordinator.post(std::make_shared<Event>(transformChangedEvent));
         }
     }
 };
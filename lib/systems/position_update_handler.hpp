@@ -3,6 +3,10 @@
 //
 
 #pragma once
+#include <unordered_map>
+
+#include "interpolation_buffer.hpp"
+#include "server_clock.hpp"
 #include "../ECS/coordinator.hpp"
 #include "../ECS/system.hpp"
 #include "../EMS/event_coordinator.hpp"
@@ -13,28 +17,92 @@ extern EventCoordinator eventCoordinator;
 extern Coordinator gCoordinator;
 
 class PositionUpdateHandler : public System {
+    // how far past the newest update a remote entity keeps moving when updates stop
+    static constexpr int64_t MAX_EXTRAPOLATION = 250;
+
+    int64_t interpolationDelay = 0;
+    std::unordered_map<Entity, InterpolationBuffer> buffers;
+
+    // shows the received transform right away without a delay, otherwise buffers it for update as of time
+    void receive(const Entity id, const Transform &received, const int64_t time) {
+        if (interpolationDelay == 0) {
+            gCoordinator.getComponent<Transform>(id) = received;
+            gCoordinator.changed(id);
+            return;
+        }
+        buffers[id].push(time, received);
+    }
+
     EventHandler positionUpdateHandler = [this](const std::shared_ptr<Event> &event) {
         if (event->type == eventTypeToString(EventType::PositionChanged)) {
-            const PositionChangedData &data = event->data;
-            const nlohmann::json received_msg = nlohmann::json::parse(data.message);
-            const SimpleMessage receivedMessage = received_msg;
-            const auto id = gCoordinator.createEntity(receivedMessage.entity_key);
-            const auto received_transform = std::get<Transform>(receivedMessage.components[0]);
+            const PositionChangedData data = event->data;
+            const auto id = gCoordinator.createEntity(data.entity_key);
 
             if (!gCoordinator.hasComponent<Transform>(id)) { return; }
 
-            auto &transform = gCoordinator.getComponent<Transform>(id);
+            // forwarded by the server without a time it was sent at
+            receive(id, data.transform, ServerClock::now());
+        }
+    };
+
+    EventHandler transformReplicatedHandler = [this](const std::shared_ptr<Event> &event) {
+        if (event->type == eventTypeToString(EventType::TransformReplicated)) {
+            const TransformReplicatedData data = event->data;
+            const auto id = gCoordinator.createEntity(data.entity_key);
+            if (!gCoordinator.hasComponent<Transform>(id)) { return; }
+            receive(id, data.transform, data.time);
+        }
+    };
 
-            transform = received_transform;
+    // an entity that comes back into view must not glide from where it was last seen
+    EventHandler interestChangedHandler = [this](const std::shared_ptr<Event> &event) {
+        if (event->type == eventTypeToString(EventType::InterestChanged)) {
+            const InterestChangedData data = event->data;
+            const auto id = gCoordinator.getEntityIds().find(data.entity_key);
+            if (id != gCoordinator.getEntityIds().end()) {
+                buffers.erase(id->second);
+            }
         }
     };
 
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     PositionUpdateHandler() {
-        eventCoordinator.subscribe(positionUpdateHandler, eventTypeToString(EventType::PositionChanged));
+        // mutates components, so it runs on the main thread even though the receiver thread emits the event
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(positionUpdateHandler, eventTypeToString(EventType::PositionChanged),
+                                             Executor::MAIN));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(transformReplicatedHandler,
+                                             eventTypeToString(EventType::TransformReplicated), Executor::MAIN));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(interestChangedHandler, eventTypeToString(EventType::InterestChanged),
+                                             Executor::MAIN));
+    }
+
+    /**
+     * Shows remote entities delay milliseconds behind when the server sent their updates, interpolating between them.
+     * 0 applies every update the moment it arrives.
+     */
+    void setInterpolationDelay(const int64_t delay) {
+        interpolationDelay = std::max<int64_t>(delay, 0);
     }
 
-    ~PositionUpdateHandler() {
-        eventCoordinator.unsubscribe(positionUpdateHandler, eventTypeToString(EventType::PositionChanged));
+    // moves the remote entities to where they were delay milliseconds ago, called once per frame
+    void update() {
+        const auto shown = ServerClock::now() - interpolationDelay;
+        for (auto it = buffers.begin(); it != buffers.end();) {
+            if (!gCoordinator.hasComponent<Transform>(it->first)) {
+                it = buffers.erase(it);
+                continue;
+            }
+            if (const auto transform = it->second.sample(shown, MAX_EXTRAPOLATION)) {
+                gCoordinator.getComponent<Transform>(it->first) = *transform;
+                gCoordinator.changed(it->first);
+            }
+            it->second.discardBefore(shown);
+            ++it;
+        }
     }
 };
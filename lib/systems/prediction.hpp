@@ -0,0 +1,93 @@
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+
+#include "../ECS/coordinator.hpp"
+#include "../ECS/system.hpp"
+#include "../EMS/event_coordinator.hpp"
+#include "../model/components.hpp"
+#include "../model/event.hpp"
+
+extern Coordinator gCoordinator;
+extern EventCoordinator eventCoordinator;
+
+/**
+ * Client side prediction of the entities with a Predicted component. They are simulated locally without waiting for
+ * the server, every frame gets the next sequence number and the state it ended in is remembered. The server answers
+ * the updates with the sequence it processed last and the state it accepted (see MovementAuthority). When it
+ * corrected the state, the entity is rewound to the corrected state of that frame and the frames the server has not
+ * processed yet are replayed on top of it, so the player ends up where the server's state plus the input since would
+ * put it without any added input latency.
+ * The movement of a frame comes from several systems (keyboard, gravity, jump, collision), so a frame is replayed
+ * by applying the movement it produced rather than running those systems again.
+ */
+class PredictionSystem : public System {
+    // frames kept per entity, about 4 seconds at 60 fps
+    static constexpr size_t HISTORY = 256;
+
+    struct Frame {
+        uint32_t sequence;
+        Transform state;
+    };
+
+    std::unordered_map<Entity, std::deque<Frame> > history;
+
+    EventHandler inputAcknowledgedHandler = [this](const std::shared_ptr<Event> &event) {
+        if (event->type == eventTypeToString(EventType::InputAcknowledged)) {
+            const InputAcknowledgedData data = event->data;
+            const auto &ids = gCoordinator.getEntityIds();
+            const auto id = ids.find(data.entity_key);
+            if (id == ids.end() || !entities.contains(id->second)) return;
+            reconcile(id->second, data);
+        }
+    };
+
+    std::vector<ScopedSubscription> subscriptions;
+
+    void reconcile(const Entity entity, const InputAcknowledgedData &data) {
+        auto &frames = history[entity];
+        // the acknowledged frame stays as the base the later ones are replayed on
+        while (!frames.empty() && frames.front().sequence < data.sequence) {
+            frames.pop_front();
+        }
+        if (frames.empty() || frames.front().sequence != data.sequence || !data.corrected) return;
+
+        const Transform predicted = frames.back().state;
+        Transform previous = frames.front().state;
+        frames.front().state.x = data.transform.x;
+        frames.front().state.y = data.transform.y;
+        for (size_t i = 1; i < frames.size(); i++) {
+            const Transform original = frames[i].state;
+            frames[i].state.x = frames[i - 1].state.x + (original.x - previous.x);
+            frames[i].state.y = frames[i - 1].state.y + (original.y - previous.y);
+            previous = original;
+        }
+
+        auto &transform = gCoordinator.getComponent<Transform>(entity);
+        transform.x += frames.back().state.x - predicted.x;
+        transform.y += frames.back().state.y - predicted.y;
+    }
+
+public:
+    PredictionSystem() {
+        // rewinds components, so it runs on the main thread
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(inputAcknowledgedHandler, eventTypeToString(EventType::InputAcknowledged),
+                                             Executor::MAIN));
+    }
+
+    void entityRemoved(const Entity entity) override {
+        history.erase(entity);
+    }
+
+    // records the state the frame was predicted to end in, called once per frame after the simulation
+    void update() {
+        for (const auto entity: entities) {
+            auto &predicted = gCoordinator.getComponent<Predicted>(entity);
+            auto &frames = history[entity];
+            frames.push_back(Frame{++predicted.sequence, gCoordinator.getComponent<Transform>(entity)});
+            if (frames.size() > HISTORY) frames.pop_front();
+        }
+    }
+};
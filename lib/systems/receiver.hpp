@@ -3,16 +3,45 @@
 //
 
 #pragma once
+#include <unordered_map>
+
 #include "../ECS/coordinator.hpp"
 #include "../ECS/system.hpp"
+#include "../EMS/event_coordinator.hpp"
 #include "../helpers/network_helper.hpp"
 #include "../model/components.hpp"
 #include "../strategy/send_strategy.hpp"
+#include "../strategy/snapshot_frame.hpp"
+#include "../strategy/transform_delta.hpp"
+#include "server_clock.hpp"
 
+extern EventCoordinator eventCoordinator;
 extern Coordinator gCoordinator;
 
 class ReceiverSystem : public System {
+    static constexpr auto PING_INTERVAL = std::chrono::seconds(1);
+    // messages handled per update at most, so events are dispatched and pings sent even under a flood
+    static constexpr int MAX_BATCH = 256;
+
     bool isReplaying = false;
+    // a welcome after the first one means the server dropped the client and registered it again
+    bool welcomed = false;
+    TransformDelta::Decoder transformDecoder;
+    ServerClock serverClock;
+    // when the snapshot being handled arrived and when the server sent it, both on the local clock
+    int64_t arrival = 0;
+    int64_t sentAt = 0;
+
+    struct Replicated {
+        Transform transform;
+        int64_t time;
+    };
+
+    // the newest transform of every entity received in the current batch, emitted once per entity when it ends
+    std::unordered_map<std::string, Replicated> replicated;
+    // the acknowledgements of all snapshots of the current batch, sent in one message
+    std::string batchAck;
+    std::chrono::steady_clock::time_point nextPing;
 
     EventHandler startReplayHandler = [this](const std::shared_ptr<Event> &event) {
         if (event->type == eventTypeToString(EventType::StartReplaying)) {
@@ -29,7 +58,9 @@ class ReceiverSystem : public System {
 private:
     void handleNormalMessage(Send_Strategy *send_strategy, zmq::message_t &copy, std::string &entity_id) {
         try {
+            const auto start = NetworkStats::Clock::now();
             SimpleMessage receivedMessage = send_strategy->parse_message(copy);
+            networkStats().decoded("message", start);
             if (receivedMessage.type == Message::SYNC) {
                 std::cout << "Syncing" << std::endl;
                 auto ids = gCoordinator.getEntityIds();
@@ -86,37 +117,173 @@ private:
         }
     }
 
-    static void handleEventMessage(const zmq::message_t &copy) {
-        const nlohmann::json eventJson = nlohmann::json::parse(copy.to_string());
-        auto event = std::make_shared<Event>();
-        from_json(eventJson, *event);
-        eventCoordinator.emit(event);
+    static void handleEventMessage(Send_Strategy *send_strategy, zmq::message_t &copy) {
+        const auto start = NetworkStats::Clock::now();
+        auto event = std::make_shared<Event>(send_strategy->parse_event(copy));
+        networkStats().decoded("event", start);
+        // the remote updates of an entity that arrive within a frame are handled once, see setCoalescible
+        eventCoordinator.post(event);
     }
 
-public:
-    ReceiverSystem() {
-        eventCoordinator.subscribe(startReplayHandler, eventTypeToString(EventType::StartReplaying));
-        eventCoordinator.subscribe(stopReplayHandler, eventTypeToString(EventType::StopReplaying));
+    static int64_t nowMicros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // the server sends the payload back, it holds the send time and the last round trip time for the server's stats
+    void sendPing(zmq::socket_t &socket) {
+        std::string ping;
+        ByteWriter writer(ping);
+        writer.svarint(nowMicros());
+        writer.svarint(networkStats().rttOf(NetworkStats::SERVER));
+        NetworkHelper::sendMessageClient(socket, NetworkHelper::PING_ID, ping);
+    }
+
+    static void handlePong(const zmq::message_t &pong) {
+        try {
+            ByteReader reader(pong.data(), pong.size());
+            networkStats().rttMeasured(NetworkStats::SERVER, nowMicros() - reader.svarint());
+        } catch (std::exception &e) {
+            std::cerr << "Error decoding pong: " << e.what() << std::endl;
+        }
+    }
+
+    // applies a transform delta, its acknowledgement is appended to ack
+    void applyTransformDelta(const std::string_view delta, std::string &ack) {
+        auto update = transformDecoder.decode(delta, ack);
+        if (!update) return;
+        replicated.insert_or_assign(std::move(update->key), Replicated{update->transform, sentAt});
+    }
+
+    // the server replicates from scratch, its deltas are no longer based on the states the decoder has
+    void handleWelcome() {
+        flushReplicated();
+        transformDecoder.reset();
+        serverClock.reset();
+        if (!welcomed) {
+            welcomed = true;
+            return;
+        }
+        eventCoordinator.emit(std::make_shared<Event>(Event{eventTypeToString(EventType::Rejoined), {}}));
     }
 
-    ~ReceiverSystem() {
-        eventCoordinator.unsubscribe(startReplayHandler, eventTypeToString(EventType::StartReplaying));
-        eventCoordinator.unsubscribe(stopReplayHandler, eventTypeToString(EventType::StopReplaying));
+    // emits the transforms coalesced so far, before anything that has to see them applied first
+    void flushReplicated() {
+        for (auto &[key, state]: replicated) {
+            const Event event{
+                eventTypeToString(EventType::TransformReplicated),
+                TransformReplicatedData{key, state.transform, state.time}
+            };
+            eventCoordinator.emit(std::make_shared<Event>(event));
+        }
+        replicated.clear();
     }
 
+    /**
+     * Handles the records of all parts of a snapshot as if they had arrived one by one. The acknowledgements of its
+     * transform deltas are sent with those of the rest of the batch so the server can send the next ones against
+     * these states.
+     */
+    void handleSnapshot(zmq::socket_t &socket, Send_Strategy *send_strategy, zmq::message_t &copy) {
+        std::vector<zmq::message_t> parts;
+        parts.push_back(std::move(copy));
+        NetworkHelper::receiveRemainingParts(socket, parts);
+        const auto start = NetworkStats::Clock::now();
+        // a snapshot without a tick is placed at its arrival
+        arrival = ServerClock::now();
+        sentAt = arrival;
+        for (const auto &part: parts) {
+            handleSnapshotPart(send_strategy, part, batchAck);
+        }
+        networkStats().decoded("snapshot", start);
+    }
+
+    void handleSnapshotPart(Send_Strategy *send_strategy, const zmq::message_t &part, std::string &ack) {
+        try {
+            SnapshotFrame::forEach(part.to_string_view(), [&](const std::string_view delta) {
+                applyTransformDelta(delta, ack);
+            }, [&](const std::string_view entityId, const std::string_view payload) {
+                flushReplicated();
+                zmq::message_t message(payload.data(), payload.size());
+                std::string id(entityId);
+                if (id == NetworkHelper::EVENT_ENTITY_ID) {
+                    handleEventMessage(send_strategy, message);
+                } else {
+                    handleNormalMessage(send_strategy, message, id);
+                }
+            }, [this](const std::string_view key, const bool entered) {
+                flushReplicated();
+                const Event event{
+                    eventTypeToString(EventType::InterestChanged),
+                    InterestChangedData{std::string(key), entered}
+                };
+                eventCoordinator.emit(std::make_shared<Event>(event));
+            }, [](const SnapshotFrame::Authority &authority) {
+                const Event event{
+                    eventTypeToString(EventType::InputAcknowledged),
+                    InputAcknowledgedData{
+                        std::string(authority.key), authority.sequence, authority.corrected, authority.transform
+                    }
+                };
+                eventCoordinator.emit(std::make_shared<Event>(event));
+            }, [this] {
+                handleWelcome();
+            }, [this](const int64_t tick) {
+                sentAt = serverClock.toLocal(tick, arrival);
+            });
+        } catch (std::exception &e) {
+            std::cerr << "Error decoding snapshot: " << e.what() << std::endl;
+        }
+    }
+
+    std::vector<ScopedSubscription> subscriptions;
+
+public:
+    ReceiverSystem() {
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(startReplayHandler, eventTypeToString(EventType::StartReplaying)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(stopReplayHandler, eventTypeToString(EventType::StopReplaying)));
+    }
+
+    /**
+     * Waits up to a frame for messages and handles everything that arrived, up to MAX_BATCH messages. Updates of the
+     * same entity within the batch are coalesced, only the newest one is emitted. While replaying nothing is handled,
+     * but the pings keep the server from dropping the client.
+     */
     void update(zmq::socket_t &socket, Send_Strategy *send_strategy) {
+        if (const auto now = std::chrono::steady_clock::now(); now >= nextPing) {
+            sendPing(socket);
+            nextPing = now + PING_INTERVAL;
+        }
         if (isReplaying) return;
         zmq::pollitem_t items[] = {{static_cast<void *>(socket), 0, ZMQ_POLLIN, 0}};
         zmq::poll(items, 1, std::chrono::milliseconds(17));
-        if (items[0].revents & ZMQ_POLLIN) {
+        if (!(items[0].revents & ZMQ_POLLIN)) return;
+
+        int handled = 0;
+        do {
             zmq::message_t copy;
             std::string entity_id;
             NetworkHelper::receiveMessageClient(socket, copy, entity_id);
-            if (entity_id == NetworkHelper::EVENT_ENTITY_ID) {
-                handleEventMessage(copy);
+            if (entity_id == NetworkHelper::SNAPSHOT_ID) {
+                handleSnapshot(socket, send_strategy, copy);
+            } else if (entity_id == NetworkHelper::PONG_ID) {
+                handlePong(copy);
+            } else if (entity_id == NetworkHelper::EVENT_ENTITY_ID) {
+                flushReplicated();
+                handleEventMessage(send_strategy, copy);
             } else {
+                flushReplicated();
                 handleNormalMessage(send_strategy, copy, entity_id);
             }
+            // ZMQ_EVENTS tells whether another message is ready without blocking for it
+        } while (++handled < MAX_BATCH && (socket.get(zmq::sockopt::events) & ZMQ_POLLIN));
+
+        flushReplicated();
+        if (!batchAck.empty()) {
+            NetworkHelper::sendMessageClient(socket, NetworkHelper::ACK_ID, batchAck);
+            batchAck.clear();
         }
     }
 };
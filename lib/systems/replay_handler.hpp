@@ -304,21 +304,20 @@ class ReplayHandler : public System {
         }
     }
 
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     ReplayHandler() {
-        eventCoordinator.subscribe(startReplayHandler, eventTypeToString(EventType::StartRecording));
-        eventCoordinator.subscribe(stopReplayHandler, eventTypeToString(EventType::StopRecording));
-        eventCoordinator.subscribe(replayHandler, eventTypeToString(EventType::StartReplaying));
-        eventCoordinator.subscribe(entityCreatedHandler, eventTypeToString(EventType::EntityCreated));
-        eventCoordinator.subscribe(entityDeletedHandler, eventTypeToString(EventType::EntityDestroyed));
-    }
-
-    ~ReplayHandler() {
-        eventCoordinator.unsubscribe(startReplayHandler, eventTypeToString(EventType::StartRecording));
-        eventCoordinator.unsubscribe(stopReplayHandler, eventTypeToString(EventType::StopRecording));
-        eventCoordinator.unsubscribe(replayHandler, eventTypeToString(EventType::StartReplaying));
-        eventCoordinator.unsubscribe(entityCreatedHandler, eventTypeToString(EventType::EntityCreated));
-        eventCoordinator.unsubscribe(entityDeletedHandler, eventTypeToString(EventType::EntityDestroyed));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(startReplayHandler, eventTypeToString(EventType::StartRecording)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(stopReplayHandler, eventTypeToString(EventType::StopRecording)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(replayHandler, eventTypeToString(EventType::StartReplaying)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(entityCreatedHandler, eventTypeToString(EventType::EntityCreated)));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(entityDeletedHandler, eventTypeToString(EventType::EntityDestroyed)));
     }
 
     void update() {
@@ -24,6 +24,9 @@ private:
             transform = respawnTransform;
             kinematic.velocity = {0, 0}; // Reset velocity on respawn
             kinematic.acceleration = {0, 0}; // Reset acceleration on respawn
+            if (gCoordinator.hasComponent<Predicted>(entity)) {
+                gCoordinator.getComponent<Predicted>(entity).teleported = true;
+            }
 
             // Emit respawn event
             Event respawnEvent{eventTypeToString(EntityRespawn), EntityRespawnData{entity}};
@@ -31,12 +34,15 @@ private:
         }
     };
 
+    std::unordered_map<Entity, ScopedSubscription> subscriptions;
+
 public:
-    RespawnSystem() {
-        eventCoordinator.subscribe(respawnHandler, eventTypeToString(EventType::EntityDeath));
+    void entityAdded(const Entity entity) override {
+        subscriptions[entity] = eventCoordinator.subscribeScoped(respawnHandler,
+                                                                 eventTypeToString(EventType::EntityDeath), entity);
     }
 
-    ~RespawnSystem() {
-        eventCoordinator.unsubscribe(respawnHandler, eventTypeToString(EventType::EntityDeath));
+    void entityRemoved(const Entity entity) override {
+        subscriptions.erase(entity);
     }
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+/**
+ * Maps the times the server stamps its snapshots with (see SnapshotFrame::TICK) onto the local steady clock, so remote
+ * states are placed on the timeline the server sent them on instead of the one they happened to arrive on. The
+ * offset between the clocks follows the earliest arrivals: a snapshot arriving early lowers it at once, one arriving
+ * late only raises it a little, so the latency and its drift are taken out but the jitter is not.
+ */
+class ServerClock {
+    // the share of its lateness a late snapshot moves the offset by
+    static constexpr double DRIFT = 0.01;
+    // milliseconds off the offset that mean the server's clock started over, a restarted server or another shard
+    static constexpr double RESYNC = 1000;
+
+    std::optional<double> offset;
+
+public:
+    // the local time in milliseconds
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // the local time the server sent at serverTime, given a snapshot stamped with it arrived at local time arrival
+    int64_t toLocal(const int64_t serverTime, const int64_t arrival) {
+        const auto sample = static_cast<double>(arrival - serverTime);
+        if (!offset || sample < *offset || sample - *offset > RESYNC) {
+            offset = sample;
+        } else {
+            *offset += (sample - *offset) * DRIFT;
+        }
+        return serverTime + std::llround(*offset);
+    }
+
+    // the next snapshot comes from a clock that has nothing to do with the last one
+    void reset() {
+        offset.reset();
+    }
+};
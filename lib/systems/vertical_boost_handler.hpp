@@ -30,12 +30,11 @@ class VerticalBoostHandler : public System {
         }
     };
 
+    std::vector<ScopedSubscription> subscriptions;
+
 public:
     VerticalBoostHandler() {
-        eventCoordinator.subscribe(triggerHandler, eventTypeToString(EventType::EntityTriggered));
-    }
-
-    ~VerticalBoostHandler() {
-        eventCoordinator.unsubscribe(triggerHandler, eventTypeToString(EventType::EntityTriggered));
+        subscriptions.push_back(
+            eventCoordinator.subscribeScoped(triggerHandler, eventTypeToString(EventType::EntityTriggered)));
     }
 };
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <memory>
 #include <thread>
 
@@ -9,7 +10,10 @@
 #include "lib/helpers/colors.hpp"
 #include "lib/helpers/constants.hpp"
 #include "lib/helpers/random.hpp"
+#include "lib/helpers/shard_endpoint.hpp"
+#include "lib/helpers/transport_config.hpp"
 #include "lib/model/components.hpp"
+#include "lib/server/server_config.hpp"
 #include "lib/systems/camera.cpp"
 #include "lib/systems/client.hpp"
 #include "lib/systems/collision.hpp"
@@ -25,6 +29,8 @@
 #include <csignal>
 
 #include "lib/strategy/send_strategy.hpp"
+#include "lib/helpers/stats_reporter.hpp"
+#include "lib/strategy/payload_samples.hpp"
 #include "lib/strategy/strategy_selector.hpp"
 #include "lib/systems/event_system.hpp"
 #include "lib/systems/keyboard.hpp"
@@ -34,6 +40,7 @@
 #include "lib/systems/dash.hpp"
 #include "lib/systems/entity_created_handler.hpp"
 #include "lib/systems/position_update_handler.hpp"
+#include "lib/systems/prediction.hpp"
 #include "lib/systems/replay_handler.hpp"
 #include "lib/systems/vertical_boost_handler.hpp"
 
@@ -82,6 +89,8 @@ void send_delete_signal(zmq::socket_t &client_socket, Entity entity, Send_Strate
         std::string entity_id = gCoordinator.getEntityKey(entity);
         NetworkHelper::sendMessageClient(client_socket, entity_id, message);
     }
+    // the server would otherwise keep sending to this client until it times out
+    NetworkHelper::sendMessageClient(client_socket, NetworkHelper::DISCONNECT_ID, "");
 }
 
 
@@ -89,25 +98,39 @@ int main(int argc, char *argv[]) {
     std::cout << ENGINE_NAME << " v" << ENGINE_VERSION << " initializing" << std::endl;
     std::cout << "Created by Utsav and Jayesh" << std::endl;
     std::cout << std::endl;
+    const auto transport = TransportConfig::fromEnvironment();
+    if (transport.inProcess()) {
+        std::cerr << "A client cannot reach a server in another process over " << transport.connect
+                << ", use SHADE_TRANSPORT=ipc or tcp" << std::endl;
+        return 1;
+    }
     initSDL();
     GameManager::getInstance()->gameRunning = true;
     catch_signals();
 
+    if (const char *journalPath = std::getenv("SHADE_EVENT_JOURNAL")) {
+        eventCoordinator.openJournal(journalPath);
+    }
+    EventCoordinator::bindThread(Executor::MAIN);
+
     std::unique_ptr<Send_Strategy> strategy = nullptr;
     if (argv[1] != nullptr) {
         strategy = Strategy::select_message_strategy(argv[1]);
     } else {
         strategy = Strategy::select_message_strategy("float");
     }
+    eventCoordinator.setEventEncoder([&strategy](Event &event) { return strategy->get_event(event); });
 
     std::string identity = Random::generateRandomID(10);
     std::cout << "Identity: " << identity << std::endl;
+    // the shard of the server this client talks to, both of its sockets go there
+    const auto server = ShardEndpoint::forClient(transport.connect, identity, ServerConfig::fromEnvironment().shards);
 
     zmq::context_t context(1);
     zmq::socket_t client_socket(context, ZMQ_DEALER);
 
     client_socket.set(zmq::sockopt::routing_id, identity);
-    client_socket.connect("tcp://localhost:5570");
+    client_socket.connect(server);
 
     zmq::pollitem_t items[] = {{client_socket, 0, ZMQ_POLLIN, 0}};
 
@@ -135,6 +158,10 @@ int main(int argc, char *argv[]) {
     gCoordinator.registerComponent<Dash>();
     gCoordinator.registerComponent<Stomp>();
     gCoordinator.registerComponent<VerticalBoost>();
+    gCoordinator.registerComponent<Predicted>();
+    // before the systems, the samples it compresses against are built from temporary entities
+    Strategy::setupCompression(strategy.get());
+    StatsReporter::startFromEnvironment("client");
 
 
     auto renderSystem = gCoordinator.registerSystem<RenderSystem>();
@@ -156,9 +183,26 @@ int main(int argc, char *argv[]) {
     auto eventSystem = gCoordinator.registerSystem<EventSystem>();
     auto entityCreatedSystem = gCoordinator.registerSystem<EntityCreatedHandler>();
     auto positionUpdateHandler = gCoordinator.registerSystem<PositionUpdateHandler>();
+    const char *interpolationDelay = std::getenv("SHADE_INTERPOLATION_DELAY");
+    positionUpdateHandler->setInterpolationDelay(interpolationDelay != nullptr
+                                                     ? std::atoi(interpolationDelay)
+                                                     : engine_constants::INTERPOLATION_DELAY);
     auto dashSystem = gCoordinator.registerSystem<DashSystem>();
     auto comboEventHandler = gCoordinator.registerSystem<ComboEventHandler>();
     auto replayHandler = gCoordinator.registerSystem<ReplayHandler>();
+    auto predictionSystem = gCoordinator.registerSystem<PredictionSystem>();
+
+    // These events only matter in their latest form, a pending duplicate is replaced instead of queued again. Remote
+    // entities are keyed by their entity key since the sender's Entity means nothing here
+    eventCoordinator.setCoalescible(eventTypeToString(EventType::PositionChanged), [](const Event &event) {
+        return static_cast<uint64_t>(std::hash<std::string>{}(event.data.at("entity_key").get<std::string>()));
+    });
+    eventCoordinator.setCoalescible(eventTypeToString(EventType::ReplayTransformChanged));
+    // A pair that keeps overlapping only needs its latest trigger
+    eventCoordinator.setCoalescible(eventTypeToString(EventType::EntityTriggered), [](const Event &event) {
+        const EntityTriggeredData data = event.data;
+        return static_cast<uint64_t>(data.triggerEntity) << 32 | data.otherEntity;
+    });
 
     Signature renderSignature;
     renderSignature.set(gCoordinator.getComponentType<Transform>());
@@ -233,14 +277,39 @@ int main(int argc, char *argv[]) {
     dashSignature.set(gCoordinator.getComponentType<CKinematic>());
     gCoordinator.setSystemSignature<DashSystem>(dashSignature);
 
+    Signature predictionSignature;
+    predictionSignature.set(gCoordinator.getComponentType<Predicted>());
+    predictionSignature.set(gCoordinator.getComponentType<Transform>());
+    gCoordinator.setSystemSignature<PredictionSystem>(predictionSignature);
+
+    Signature keyboardSignature;
+    keyboardSignature.set(gCoordinator.getComponentType<KeyboardMovement>());
+    keyboardSignature.set(gCoordinator.getComponentType<CKinematic>());
+    keyboardSignature.set(gCoordinator.getComponentType<Jump>());
+    keyboardSignature.set(gCoordinator.getComponentType<Dash>());
+    keyboardSignature.set(gCoordinator.getComponentType<Stomp>());
+    gCoordinator.setSystemSignature<KeyboardSystem>(keyboardSignature);
+
+    Signature respawnHandlerSignature;
+    respawnHandlerSignature.set(gCoordinator.getComponentType<Respawnable>());
+    respawnHandlerSignature.set(gCoordinator.getComponentType<Transform>());
+    respawnHandlerSignature.set(gCoordinator.getComponentType<CKinematic>());
+    gCoordinator.setSystemSignature<RespawnSystem>(respawnHandlerSignature);
+
+    Signature comboSignature;
+    comboSignature.set(gCoordinator.getComponentType<Dash>());
+    gCoordinator.setSystemSignature<ComboEventHandler>(comboSignature);
+
     zmq::socket_t reply_socket(context, ZMQ_DEALER);
     std::string id = identity + "R";
     reply_socket.set(zmq::sockopt::routing_id, id);
-    reply_socket.connect("tcp://localhost:5570");
+    reply_socket.connect(server);
 
     std::thread t1([receiverSystem, &reply_socket, &strategy]() {
+        EventCoordinator::bindThread(Executor::NETWORK);
         while (GameManager::getInstance()->gameRunning) {
             receiverSystem->update(reply_socket, strategy.get());
+            eventCoordinator.dispatch(Executor::NETWORK);
         }
     });
 
@@ -264,13 +333,12 @@ int main(int argc, char *argv[]) {
     gCoordinator.addComponent(mainChar, Collision{true, false, CollisionLayer::PLAYER});
     gCoordinator.addComponent(mainChar, Dash{});
     gCoordinator.addComponent(mainChar, Stomp{});
+    gCoordinator.addComponent(mainChar, Predicted{});
     std::cout << "MainChar: " << gCoordinator.getEntityKey(mainChar) << std::endl;
     mainCharID = gCoordinator.getEntityKey(mainChar);
 
-    Event entityCreatedEvent{eventTypeToString(MainCharCreated), {}};
-    entityCreatedEvent.data = MainCharCreatedData{mainChar, strategy->get_message(mainChar, Message::CREATE)};
-    eventCoordinator.emitServer(client_socket, std::make_shared<Event>(entityCreatedEvent));
-    gCoordinator.getComponent<ClientEntity>(mainChar).synced = true;
+    // goes out once the sender thread runs
+    clientSystem->announce(mainChar);
 
 
     auto clientEntity = gCoordinator.createEntity();
@@ -280,9 +348,9 @@ int main(int argc, char *argv[]) {
 
 
     // Start the message sending thread
-    std::thread t2([&client_socket, &clientSystem, &strategy] {
+    std::thread t2([&client_socket, &clientSystem] {
         while (GameManager::getInstance()->gameRunning) {
-            clientSystem->update(client_socket, strategy.get());
+            clientSystem->update(client_socket);
         }
     });
 
@@ -304,11 +372,15 @@ int main(int argc, char *argv[]) {
         collisionSystem->update();
         deathSystem->update();
         destroySystem->update();
+        predictionSystem->update();
+        positionUpdateHandler->update();
         cameraSystem->update(mainChar);
         renderSystem->update(mainCamera);
         eventSystem->update();
         dashSystem->update(dt);
         replayHandler->update();
+        // the sender thread sends what moved this frame
+        clientSystem->publish();
 
         auto elapsed_time = gameTimeline.getElapsedTime();
         auto time_to_sleep = (1.0f / 60.0f) - (elapsed_time - current_time); // Ensure float division
@@ -325,6 +397,7 @@ int main(int argc, char *argv[]) {
     send_delete_signal(client_socket, mainChar, strategy.get());
     t1.join();
     t2.join();
+    std::cout << "Compression: " << Compression::summary() << std::endl;
     cleanupSDL();
     std::cout << "Closing " << ENGINE_NAME << " Engine" << std::endl;
     return 0;
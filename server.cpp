@@ -3,6 +3,7 @@
 //
 
 #include <thread>
+#include <cstdlib>
 #include <memory>
 #include <csignal>
 #include <zmq.hpp>
@@ -15,7 +16,12 @@
 #include "lib/helpers/colors.hpp"
 #include "lib/helpers/constants.hpp"
 #include "lib/helpers/random.hpp"
-#include "lib/server/worker.hpp"
+#include "lib/server/server_config.hpp"
+#include "lib/server/shard.hpp"
+#include "lib/helpers/shard_endpoint.hpp"
+#include "lib/helpers/transport_config.hpp"
+#include "lib/helpers/stats_reporter.hpp"
+#include "lib/strategy/payload_samples.hpp"
 #include "lib/strategy/strategy_selector.hpp"
 #include "lib/systems/kinematic.cpp"
 #include "lib/systems/render.cpp"
@@ -54,26 +60,20 @@ void platform_movement(Timeline &timeline, MoveBetween2PointsSystem &moveBetween
     std::cout << "Kill platform thread" << std::endl;
 }
 
-void server_run(zmq::context_t &context, zmq::socket_ref frontend, zmq::socket_ref backend,
-                Send_Strategy *send_strategy) {
-    int max_threads = 5;
-
-    std::vector<std::unique_ptr<Worker> > workers;
-    std::vector<std::unique_ptr<std::thread> > threads;
-    std::unordered_set<std::string> clients;
-    std::shared_mutex clients_mutex;
-
-    for (int i = 0; i < max_threads; i++) {
-        workers.push_back(std::make_unique<Worker>(context, ZMQ_DEALER, "WORKER" + std::to_string(i)));
-        threads.push_back(std::make_unique<std::thread>(&Worker::work, workers[i].get(), send_strategy,
-                                                        std::ref(clients), std::ref(clients_mutex)));
-        threads[i]->detach();
+void server_run(std::vector<std::unique_ptr<Shard> > &shards, Send_Strategy *send_strategy) {
+    WorldBootstrap bootstrap;
+    for (const auto &shard: shards) {
+        shard->start(send_strategy, bootstrap);
     }
 
-    try {
-        zmq::proxy(zmq::socket_ref(frontend), zmq::socket_ref(backend), nullptr);
-    } catch (std::exception &e) {
-        std::cout << "Server error: " << e.what() << std::endl;
+    // every shard forwards on its own thread, the first one on this one
+    std::vector<std::thread> proxies;
+    for (size_t i = 1; i < shards.size(); i++) {
+        proxies.emplace_back(&Shard::proxy, shards[i].get());
+    }
+    shards[0]->proxy();
+    for (auto &proxy: proxies) {
+        proxy.join();
     }
     std::cout << "Kill server thread" << std::endl;
 }
@@ -105,12 +105,18 @@ int main(int argc, char *argv[]) {
     std::cout << std::endl;
     GameManager::getInstance()->gameRunning = true;
     anchorTimeline.start();
+
+    if (const char *journalPath = std::getenv("SHADE_EVENT_JOURNAL")) {
+        eventCoordinator.openJournal(journalPath);
+    }
+    EventCoordinator::bindThread(Executor::MAIN);
     std::unique_ptr<Send_Strategy> strategy = nullptr;
     if (argv[1] != nullptr) {
         strategy = Strategy::select_message_strategy(argv[1]);
     } else {
         strategy = Strategy::select_message_strategy("float");
     }
+    eventCoordinator.setEventEncoder([&strategy](Event &event) { return strategy->get_event(event); });
 
     Timeline gameTimeline(&anchorTimeline, 1);
     gameTimeline.start();
@@ -133,6 +139,10 @@ int main(int argc, char *argv[]) {
     gCoordinator.registerComponent<RigidBody>();
     gCoordinator.registerComponent<Respawnable>();
     gCoordinator.registerComponent<VerticalBoost>();
+    gCoordinator.registerComponent<Predicted>();
+    // before the systems, the samples it compresses against are built from temporary entities
+    Strategy::setupCompression(strategy.get());
+    StatsReporter::startFromEnvironment("server");
 
     auto renderSystem = gCoordinator.registerSystem<RenderSystem>();
     auto kinematicSystem = gCoordinator.registerSystem<KinematicSystem>();
@@ -262,13 +272,17 @@ int main(int argc, char *argv[]) {
 
     std::cout << "Platform2: " << gCoordinator.getEntityKey(platform2) << std::endl;
 
+    const auto config = ServerConfig::fromEnvironment();
+    const auto transport = TransportConfig::fromEnvironment();
+    std::cout << "Sending snapshots at " << config.tickRate << " Hz, interest radius " << config.interestRadius
+            << ", client timeout " << config.clientTimeout << " s, " << config.shards << " shards of "
+            << config.workers << " workers, listening on " << transport.bind << std::endl;
     zmq::context_t context(1);
-    zmq::socket_t frontend(context, ZMQ_ROUTER);
-    zmq::socket_t backend(context, ZMQ_DEALER);
-    frontend.bind("tcp://*:5570");
-    backend.bind("tcp://*:5571");
-    std::thread server_thread(server_run, std::ref(context), zmq::socket_ref(frontend), zmq::socket_ref(backend),
-                              strategy.get());
+    std::vector<std::unique_ptr<Shard> > shards;
+    for (int i = 0; i < config.shards; i++) {
+        shards.push_back(std::make_unique<Shard>(context, i, config, transport.bind));
+    }
+    std::thread server_thread(server_run, std::ref(shards), strategy.get());
 
     std::string identity = Random::generateRandomID(10);
     std::cout << "Identity: " << identity << std::endl;
@@ -276,7 +290,7 @@ int main(int argc, char *argv[]) {
     zmq::socket_t client_socket(context, ZMQ_DEALER);
 
     client_socket.set(zmq::sockopt::routing_id, identity);
-    client_socket.connect("tcp://localhost:5570");
+    client_socket.connect(ShardEndpoint::forClient(transport.connect, identity, config.shards));
 
     Entity server = gCoordinator.createEntity();
     gCoordinator.addComponent(server, Server{7000, 7001});
@@ -287,19 +301,21 @@ int main(int argc, char *argv[]) {
         platform_movement(gameTimeline, *moveBetween2PointsSystem);
     });
 
-    std::thread t2([&client_socket, &clientSystem, &strategy] {
+    std::thread t2([&client_socket, &clientSystem] {
         while (GameManager::getInstance()->gameRunning) {
-            clientSystem->update(client_socket, strategy.get());
+            clientSystem->update(client_socket);
         }
     });
 
-    std::thread t1([receiverSystem, &context, &identity, &strategy]() {
+    std::thread t1([receiverSystem, &context, &identity, &strategy, &config, &transport]() {
         zmq::socket_t socket(context, ZMQ_DEALER);
         std::string id = identity + "R";
         socket.set(zmq::sockopt::routing_id, id);
-        socket.connect("tcp://localhost:5570");
+        socket.connect(ShardEndpoint::forClient(transport.connect, identity, config.shards));
+        EventCoordinator::bindThread(Executor::NETWORK);
         while (GameManager::getInstance()->gameRunning) {
             receiverSystem->update(socket, strategy.get());
+            eventCoordinator.dispatch(Executor::NETWORK);
         }
     });
 
@@ -313,6 +329,8 @@ int main(int argc, char *argv[]) {
         kinematicSystem->update(dt);
         destroySystem->update();
         eventSystem->update();
+        // the sender thread sends what moved this frame
+        clientSystem->publish();
 
         auto elapsed_time = gameTimeline.getElapsedTime();
         auto time_to_sleep = (1.0f / 60.0f) - (elapsed_time - current_time); // Ensure float division
@@ -320,6 +338,7 @@ int main(int argc, char *argv[]) {
             std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(time_to_sleep * 1000)));
         }
     }
+    std::cout << "Compression: " << Compression::summary() << std::endl;
 
     // Create 4 Rectangle instances
     platform_thread.join();
@@ -0,0 +1,99 @@
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../lib/EMS/event_journal.hpp"
+
+/**
+ * Prints the events recorded in an event journal (see SHADE_EVENT_JOURNAL), oldest first.
+ * Usage: shade_engine_journal <file> [--type <EventType>] [--kind emit|queue|send] [--last <n>] [--json]
+ * With --json every event is printed as one JSON object per line so it can be fed back into the engine or a script.
+ */
+namespace {
+    std::string formatTime(const int64_t wallTime) {
+        const std::time_t seconds = wallTime / 1000000000;
+        std::tm local{};
+        localtime_r(&seconds, &local);
+        std::ostringstream out;
+        out << std::put_time(&local, "%H:%M:%S") << "." << std::setw(6) << std::setfill('0')
+                << wallTime % 1000000000 / 1000;
+        return out.str();
+    }
+
+    void usage() {
+        std::cerr << "Usage: shade_engine_journal <file> [--type <EventType>] [--kind emit|queue|send] [--last <n>] "
+                "[--json]" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string type;
+    std::string kind;
+    size_t last = 0;
+    bool json = false;
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--type" && i + 1 < argc) {
+            type = argv[++i];
+        } else if (arg == "--kind" && i + 1 < argc) {
+            kind = argv[++i];
+        } else if (arg == "--last" && i + 1 < argc) {
+            last = std::stoul(argv[++i]);
+        } else if (arg == "--json") {
+            json = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    journal::MappedFile reader;
+    if (!reader.open(argv[1], false) || !reader.valid()) {
+        std::cerr << argv[1] << " is not an event journal" << std::endl;
+        return 1;
+    }
+
+    std::deque<std::string> lines;
+    size_t matched = 0;
+    reader.forEach([&](const journal::Record &record) {
+        if (!type.empty() && record.type != type) return;
+        if (!kind.empty() && kind != journal::kindToString(record.kind)) return;
+        nlohmann::json data;
+        try {
+            data = nlohmann::json::from_msgpack(record.payload, record.payload + record.payloadSize);
+        } catch (const nlohmann::json::exception &e) {
+            data = std::string("<unreadable payload: ") + e.what() + ">";
+        }
+        std::string line;
+        if (json) {
+            line = nlohmann::json{
+                {"time", record.wallTime}, {"kind", journal::kindToString(record.kind)}, {"type", record.type},
+                {"scheduled", record.scheduled}, {"data", data}
+            }.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        } else {
+            std::ostringstream out;
+            out << formatTime(record.wallTime) << " " << std::left << std::setw(6) << journal::kindToString(record.kind)
+                    << std::setw(24) << record.type
+                    << data.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+            if (record.kind == journal::QUEUED) out << " @" << record.scheduled;
+            line = out.str();
+        }
+        matched++;
+        lines.push_back(std::move(line));
+        if (last > 0 && lines.size() > last) lines.pop_front();
+    });
+
+    for (const auto &line: lines) {
+        std::cout << line << "\n";
+    }
+    if (!json) std::cerr << matched << " events" << std::endl;
+    return 0;
+}